@@ -57,6 +57,20 @@ extern "C" {
     #define __PLATFORM_INIT__(me) (me)->msg_queue_id = xQueueCreate(AO_QUEUE_SIZE, sizeof(message_frame_t));
 #endif
 
+/** @def AO_FSM_TRACE
+ *  @brief Set to 1 to give every Active Object an FSM trace ring (see fsm_trace_t).
+ */
+#ifndef AO_FSM_TRACE
+#define AO_FSM_TRACE 1
+#endif
+
+#if AO_FSM_TRACE
+    /** @brief Attaches the Active Object's trace ring to its FSM. */
+    #define __TRACE_INIT__(me) fsm_trace_enable(&(me)->fsm, &(me)->trace);
+#else
+    #define __TRACE_INIT__(me)
+#endif
+
 #ifdef __linux__
 #define THREAD_INIT 0
 #else
@@ -83,7 +97,8 @@ extern "C" {
         (me)->super.name[sizeof((me)->super.name) - 1] = '\0'; \
         __PLATFORM_INIT__(&me->super);														\
         (me)->super.thread_id = THREAD_INIT;                       \
-        (me)->super.fsm.super = (void*) &(me)->super;
+        (me)->super.fsm.super = (void*) &(me)->super;          \
+        __TRACE_INIT__(&(me)->super)
 
 /** @typedef base_vtable_t
  *  @brief Typedef for the Active Object virtual table structure.
@@ -139,6 +154,8 @@ typedef struct {
 
 void MsgQueue_Init(MsgQueue_t *q);
 void MsgQueue_Push(MsgQueue_t *q, const message_frame_t *m);
+uint8_t MsgQueue_TryPush(MsgQueue_t *q, const message_frame_t *m, uint8_t urgent);
+uint8_t MsgQueue_TimedPush(MsgQueue_t *q, const message_frame_t *m, uint32_t timeout_ms);
 uint8_t MsgQueue_Pop(MsgQueue_t *q, message_frame_t *out);
 
 #endif
@@ -249,6 +266,16 @@ struct base_obj {
 	 */
 	fsm_t fsm; /**< Finite state machine */
 
+#if AO_FSM_TRACE
+	/**
+	 * @brief Trace ring recording the events processed by `fsm`.
+	 *
+	 * Filled by fsm_handler() on the Active Object thread and read
+	 * lock-free with fsm_trace_snapshot() (e.g. from the web server).
+	 */
+	fsm_trace_t trace; /**< FSM trace ring */
+#endif
+
 	/**
 	 * @brief Pointer to the initial state of the Active Object.
 	 *
@@ -421,6 +448,34 @@ void stop(base_obj_t *const me);
  */
 void post(base_obj_t *const me, const message_frame_t frame);
 
+/**
+ * @brief Posts a message to the Active Object without blocking.
+ *
+ * Used by contexts that must never stall on a full queue, such as the timer
+ * thread delivering time events. An urgent message is queued ahead of
+ * everything already waiting, so it is dispatched next.
+ *
+ * @param me Pointer to the Active Object instance.
+ * @param frame Pointer to the message frame to be added to the queue.
+ * @param urgent Non-zero to queue the message at the front.
+ * @return 1 if the message was queued, 0 if the queue was full.
+ */
+uint8_t try_post(base_obj_t *const me, const message_frame_t *frame, uint8_t urgent);
+
+/**
+ * @brief Posts a message to the Active Object, waiting at most @p timeout_ms
+ *        for room in the queue.
+ *
+ * For producer threads that must wait on a full queue like post() but also
+ * notice, between waits, that they are being asked to stop.
+ *
+ * @param me Pointer to the Active Object instance.
+ * @param frame Pointer to the message frame to be added to the queue.
+ * @param timeout_ms Longest wait for a free slot, in milliseconds.
+ * @return 1 if the message was queued, 0 if the queue stayed full.
+ */
+uint8_t post_timeout(base_obj_t *const me, const message_frame_t *frame, uint32_t timeout_ms);
+
 /**
  * @brief Logs a message.
  *
@@ -458,6 +513,18 @@ void register_active_object(base_obj_t *me);
  */
 void unregister_active_object(const base_obj_t * me);
 
+/**
+ * @brief Takes a consistent copy of the active object registry.
+ *
+ * Use this instead of reading `active_objects` directly from a thread that
+ * does not start or stop AOs.
+ *
+ * @param out Destination array.
+ * @param max Capacity of @p out in entries.
+ * @return Number of entries written to @p out.
+ */
+int active_object_snapshot(base_obj_t **out, int max);
+
 /**
  * @brief Retrieves the current system time in milliseconds.
  * @return The current system time in milliseconds.
@@ -19,6 +19,16 @@ extern "C" {
 #include <stdint.h>
 #include "message.h"
 
+/** @brief Number of self-posted events an FSM can hold before they are drained. */
+#ifndef FSM_INTERNAL_QUEUE_SIZE
+#define FSM_INTERNAL_QUEUE_SIZE 4
+#endif
+
+/** @brief Number of entries kept by an FSM trace ring (must be a power of two). */
+#ifndef FSM_TRACE_LEN
+#define FSM_TRACE_LEN 32
+#endif
+
 /**
  * @typedef fsm_t
  * @brief Defines a type for a finite state machine (FSM) instance.
@@ -90,8 +100,35 @@ struct state {
     action_function on_exit;    /**< Function executed upon exiting the state. */
     transition_t *transitions;  /**< Pointer to an array of valid transitions. */
     uint8_t transition_count;   /**< Number of available transitions. */
+    const char *name;           /**< Optional state name, used by the trace ring. */
 };
 
+/**
+ * @struct fsm_trace_entry_t
+ * @brief One record of the FSM trace ring, written per processed event.
+ */
+typedef struct {
+    uint32_t seq;               /**< Write sequence (odd while the entry is being written). */
+    uint32_t signal;            /**< Signal of the processed event. */
+    uint64_t timestamp_us;      /**< Monotonic time at which processing started. */
+    const state_t *state;       /**< State the event was delivered to. */
+    const state_t *next_state;  /**< Target state if a transition was taken, NULL otherwise. */
+    uint32_t duration_us;       /**< Time spent in exit/transition/entry actions and handler. */
+} fsm_trace_entry_t;
+
+/**
+ * @struct fsm_trace_t
+ * @brief Fixed-size, lock-free trace ring filled by fsm_handler().
+ *
+ * There is a single writer (the thread running the FSM). Readers on any
+ * thread take a consistent copy with fsm_trace_snapshot(), which skips
+ * entries that are overwritten while being copied.
+ */
+typedef struct {
+    fsm_trace_entry_t entries[FSM_TRACE_LEN]; /**< Circular record buffer. */
+    uint32_t head;                            /**< Total number of records written. */
+} fsm_trace_t;
+
 /**
  * @struct fsm
  * @brief Represents a finite state machine instance.
@@ -99,6 +136,23 @@ struct state {
 struct fsm {
     state_t *current_state; /**< Pointer to the current active state. */
     void *super;            /**< Pointer to the parent object (if any). */
+
+    /**
+     * @brief Run-to-completion queue for events the FSM posts to itself.
+     *
+     * Filled by fsm_post_internal() from entry/exit actions and handlers,
+     * and drained by fsm_init()/fsm_handler() before they return, so the
+     * next external message is only seen once every self-posted event has
+     * been processed.
+     */
+    struct {
+        message_frame_t buf[FSM_INTERNAL_QUEUE_SIZE]; /**< Circular buffer. */
+        uint8_t head;  /**< Index of the oldest pending event. */
+        uint8_t tail;  /**< Index where the next event is stored. */
+        uint8_t count; /**< Number of pending events. */
+    } internal;
+
+    fsm_trace_t *trace;     /**< Optional trace ring, NULL when tracing is disabled. */
 };
 
 /**
@@ -127,6 +181,46 @@ void fsm_init(fsm_t *fsm, state_t *initial);
  */
 void fsm_handler(fsm_t *fsm, const message_frame_t *event);
 
+/**
+ * @brief Posts an event to the FSM's own internal queue.
+ *
+ * Intended for signals an FSM sends to itself (e.g. a state-change request
+ * raised from an entry action). The event is processed synchronously, after
+ * the current event and before the next external message, without going
+ * through the Active Object message queue.
+ *
+ * Must only be called from the thread that runs the FSM.
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param event Pointer to the event to be queued (copied).
+ * @return 1 if the event was queued, 0 if the internal queue is full.
+ */
+uint8_t fsm_post_internal(fsm_t *fsm, const message_frame_t *event);
+
+/**
+ * @brief Attaches a trace ring to the FSM (or detaches it with NULL).
+ *
+ * Once attached, every event processed by fsm_handler() is recorded with
+ * its timestamp, the current state, the transition taken and the time spent
+ * handling it.
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param trace Pointer to the trace ring storage, or NULL to disable tracing.
+ */
+void fsm_trace_enable(fsm_t *fsm, fsm_trace_t *trace);
+
+/**
+ * @brief Copies the most recent trace records, oldest first.
+ *
+ * Safe to call from any thread while the FSM is running.
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param out Destination array.
+ * @param max Capacity of @p out in entries.
+ * @return Number of entries copied (0 if tracing is disabled).
+ */
+uint16_t fsm_trace_snapshot(const fsm_t *fsm, fsm_trace_entry_t *out, uint16_t max);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,123 @@
+/**
+ * @file json_writer.h
+ * @brief Streaming JSON writer for hot serialization paths.
+ *
+ * The writer appends JSON text straight into a character buffer instead of
+ * building a cJSON tree and printing it: no node is allocated per value and
+ * the text is produced in a single pass. Commas, nesting and string escaping
+ * are handled by the writer, so callers only emit keys and values in order.
+ *
+ * Two buffer modes are supported:
+ *  - fixed: a caller-provided (typically stack or pooled) buffer. Nothing is
+ *    ever allocated; when the buffer runs out the writer stops and reports
+ *    the overflow from json_writer_finish().
+ *  - growable: a heap buffer owned by the writer and doubled with realloc()
+ *    as needed, for output of unbounded size (table dumps, MIB trees). The
+ *    finished buffer is handed over to the caller, who frees it.
+ *
+ * @author Nathan Ikolo
+ * @date October 18, 2026
+ */
+
+#ifndef INCLUDE_JSON_WRITER_H_
+#define INCLUDE_JSON_WRITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/** @brief Deepest object/array nesting the writer tracks. */
+#define JSON_WRITER_MAX_DEPTH 32
+
+/**
+ * @brief Writer state. Treat as opaque; initialise with json_writer_init()
+ *        or json_writer_init_dynamic().
+ */
+typedef struct {
+	char *buf; /**< Output text, kept NUL-terminated. */
+	size_t len; /**< Bytes written, excluding the NUL. */
+	size_t cap; /**< Size of @ref buf in bytes. */
+	uint32_t more; /**< Bit d set: container at depth d already has a member. */
+	uint8_t depth; /**< Current nesting depth (0 = top level). */
+	uint8_t after_key; /**< A key was just written; next value takes no comma. */
+	uint8_t growable; /**< @ref buf is heap memory the writer may realloc(). */
+	uint8_t failed; /**< Out of space or nesting error; output is invalid. */
+} json_writer_t;
+
+/**
+ * @brief Initialise a writer over a fixed caller buffer. Never allocates.
+ *
+ * @param w   Writer to initialise.
+ * @param buf Output buffer.
+ * @param cap Size of @p buf in bytes (at least 1).
+ */
+void json_writer_init(json_writer_t *w, char *buf, size_t cap);
+
+/**
+ * @brief Initialise a writer over a growable heap buffer.
+ *
+ * @param w       Writer to initialise.
+ * @param initial Initial capacity in bytes; grown by doubling.
+ * @return true on success, false if the initial allocation failed.
+ */
+bool json_writer_init_dynamic(json_writer_t *w, size_t initial);
+
+/**
+ * @brief Terminate the output and return it.
+ *
+ * For a growable writer ownership of the returned buffer passes to the
+ * caller (free() it); on failure the buffer is released here.
+ *
+ * @param w   Writer.
+ * @param len Optional; receives the text length.
+ * @return The NUL-terminated JSON text, or NULL if the writer ran out of
+ *         space or the containers were not balanced.
+ */
+char* json_writer_finish(json_writer_t *w, size_t *len);
+
+/** @brief Open an object `{`. */
+void json_object_begin(json_writer_t *w);
+/** @brief Close the innermost object `}`. */
+void json_object_end(json_writer_t *w);
+/** @brief Open an array `[`. */
+void json_array_begin(json_writer_t *w);
+/** @brief Close the innermost array `]`. */
+void json_array_end(json_writer_t *w);
+
+/**
+ * @brief Write an object member name; the next call writes its value.
+ *
+ * @param w   Writer.
+ * @param key NUL-terminated member name, escaped as a string.
+ */
+void json_key(json_writer_t *w, const char *key);
+
+/** @brief Write a NUL-terminated string value, escaped. NULL writes null. */
+void json_string(json_writer_t *w, const char *s);
+/** @brief Write @p n bytes of @p s as an escaped string value. */
+void json_string_n(json_writer_t *w, const char *s, size_t n);
+/** @brief Write a signed integer value. */
+void json_int(json_writer_t *w, int64_t v);
+/** @brief Write an unsigned integer value. */
+void json_uint(json_writer_t *w, uint64_t v);
+/**
+ * @brief Write a floating-point value. Integral values print without a
+ *        fraction and non-finite values print as null, as cJSON does.
+ */
+void json_double(json_writer_t *w, double v);
+/** @brief Write true or false. */
+void json_bool(json_writer_t *w, bool v);
+/** @brief Write null. */
+void json_null(json_writer_t *w);
+/** @brief Write @p n bytes of already encoded JSON as one value, verbatim. */
+void json_raw(json_writer_t *w, const char *json, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_JSON_WRITER_H_ */
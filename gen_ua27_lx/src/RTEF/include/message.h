@@ -83,6 +83,10 @@ typedef enum {
 } sig_id_t;
 
 
+/* --- Time events for the Watchdog AO --- */
+#define WDG_TIME_HEARTBEAT					AO_SIGNAL(SIG_SEVERITY_INFO,	SIG_STATE_OPERATIONAL,			SIG_TYPE_MONITORING,1)
+#define WDG_TIME_MONITOR					AO_SIGNAL(SIG_SEVERITY_INFO,	SIG_STATE_OPERATIONAL,			SIG_TYPE_MONITORING,2)
+
 #define DB_MSG_ID(action,table,row)			(action & 0x7) << 13 | (table & 0x1F) << 8 | (row & 0xFF)
 
 #define DB_CHANGE_STATE_OP					AO_SIGNAL(SIG_SEVERITY_INFO,	SIG_STATE_OPERATIONAL,			SIG_TYPE_DATABASE,1)
@@ -105,6 +109,12 @@ typedef enum {
 #define SNMP_GET_TX(dest)					AO_SIGNAL(SIG_SEVERITY_INFO,	SIG_STATE_OPERATIONAL,			SIG_TYPE_SNMP,			SNMP_MGS_ID(SNMP_GET_SENT,dest))
 #define SNMP_SET_VALUE(dest)				AO_SIGNAL(SIG_SEVERITY_INFO,	SIG_STATE_OPERATIONAL,			SIG_TYPE_SNMP,			SNMP_MGS_ID(SNMP_SET_VAR,dest))
 
+/* --- Time events for the CAN AO: request timeout, keyed by correlation ID --- */
+#define CAN_CORRELATION_MASK				0x3FFFFFu
+#define CAN_TIMEOUT(corr)					AO_SIGNAL(SIG_SEVERITY_WARNING,	SIG_STATE_OPERATIONAL,			SIG_TYPE_CAN,			((corr) & CAN_CORRELATION_MASK))
+#define CAN_IS_TIMEOUT(signal)				(((signal) & ~CAN_CORRELATION_MASK) == CAN_TIMEOUT(0))
+#define CAN_GET_CORRELATION_ID(signal)		((signal) & CAN_CORRELATION_MASK)
+
 #define WS_MGS_ID(action,fd,oid)			(action & 0x3) << 20 | fd << 15 | (oid)
 /* --- Signals for the WebServer AO (reuse your SIG_TYPE_HTTP bucket) --- */
 #define WS_CHANGE_STATE_INIT  				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_INITIALISATION, 		SIG_TYPE_HTTP, 1)
@@ -114,13 +124,35 @@ typedef enum {
 /* Pump -> AO runtime events */
 #define WS_EVT_NEW_CONN       				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 10)
 #define WS_EVT_WS_OPEN        				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 11)
+/* Text message from a client: payload is the client index, then the text;
+ * longer texts are in ptr instead, which the WS AO frees */
 #define WS_EVT_WS_MSG_RX      				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 12)
 #define WS_EVT_CLIENT_CLOSED  				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 13)
+/* Binary broker frame from a WS_SUBPROTOCOL client: payload is the client
+ * index, the frame's signal (both host order), then its payload bytes, or
+ * ptr holds them when they do not fit (freed by the WS AO) */
+#define WS_EVT_WS_BIN_RX      				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 14)
 
 /* AO -> Pump commands (async send) */
 #define WS_CMD_SEND_TO_ONE    				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 20)
 #define WS_CMD_BROADCAST      				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 21)
 
+/* Client -> AO diagnostics queries (answered directly to the requesting client) */
+#define WS_TRACE_QUERY        				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 30)
+#define WS_TIMER_QUERY        				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 31)
+#define WS_CLIENTS_QUERY      				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 33)
+
+/* Client -> AO live document subscription. Payload lists the topics as
+ * "doc[:slot],..." (e.g. "module_control:2,sidebar"), no slot meaning every
+ * slot; it replaces the client's previous set, an empty list unsubscribes. */
+#define WS_LIVE_SUBSCRIBE     				AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 32)
+
+/* Live JSON document record: payload (or ptr, which the WS AO takes over and
+ * frees) holds `length` bytes of JSON for record `slot` of document `doc`
+ * (ws_doc_t). Log records are appended whatever the slot. */
+#define WS_LIVE_ID(doc,slot)				(0x100 | ((doc) & 0xF) << 4 | ((slot) & 0xF))
+#define WS_LIVE_UPDATE(doc,slot)			AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 		WS_LIVE_ID(doc,slot))
+
 #define WS_QUERY_TX_CMD(fd,dest)      		AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 		WS_MGS_ID(WS_QUERY_TX,fd,dest))
 #define WS_QUERY_RX_CMD(fd,dest)      		AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 		WS_MGS_ID(WS_QUERY_RX,fd,dest))
 #define WS_SET_CMD(fd,dest)		      		AO_SIGNAL(SIG_SEVERITY_INFO,  	SIG_STATE_OPERATIONAL,    		SIG_TYPE_HTTP, 		WS_MGS_ID(WS_COMMAND,fd,dest))
@@ -6,8 +6,8 @@
  * registration of callback functions, enabling/disabling timers, and
  * handling priority-based scheduling of timer callbacks.
  *
- * It supports both Windows (using threads and waitable timers) and
- * FreeRTOS (using software timers).
+ * On Linux all timers are serviced by a single thread driving a
+ * hierarchical timing wheel from one `timerfd`.
  *
  * @author Nathan Ikolo
  * @date February 24, 2025
@@ -28,11 +28,57 @@ extern "C" {
 #include <errno.h>
 #include <time.h>
 
-/** @brief Maximum number of system timers that can be created. */
+/** @brief Number of predefined (legacy) timer periods. */
 #define MAX_TIMERS 3
 
+/** @brief Resolution of the timing wheel in milliseconds. */
+#define TIMER_TICK_MS 1
+
+/** @brief Number of slots per timing-wheel level (as a power of two). */
+#define TIMER_WHEEL_BITS 6
+
+/** @brief Number of timing-wheel levels. */
+#define TIMER_WHEEL_LEVELS 4
+
+/** @brief Longest period/delay the wheel can hold, in ticks (about 4.6 hours). */
+#define TIMER_MAX_PERIOD_MS ((1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1UL)
+
+/** @brief Timer id recorded for entries created with an explicit period. */
+#define TIMER_CUSTOM 0xFF
+
+/**
+ * @brief Slack given to a new entry: how late (in ms) it may fire so its
+ *        expiry can share a wake-up with another timer. Defaults to 1/64 of
+ *        the period, which keeps short periods exact; see `set_slack()`.
+ */
+#ifndef TIMER_DEFAULT_SLACK_MS
+#define TIMER_DEFAULT_SLACK_MS(period_ms) ((period_ms) >> 6)
+#endif
+
+/** @brief Number of preallocated timer entries shared by all users. */
+#ifndef TIMER_POOL_SIZE
+#define TIMER_POOL_SIZE 64
+#endif
+
+/** @brief Handle value never returned for a live timer. */
+#define TIMER_HANDLE_INVALID 0u
+
+/**
+ * @typedef timer_handle_t
+ * @brief Generation-counted reference to a pooled timer entry.
+ *
+ * The low 16 bits hold the pool index plus one, the high 16 bits the entry's
+ * generation. The generation changes whenever the entry returns to the pool,
+ * so a handle kept past its timer's expiry or cancellation is recognised as
+ * stale instead of touching whichever timer reuses the entry.
+ */
+typedef uint32_t timer_handle_t;
+
 /**
  * @brief Predefined timer intervals.
+ *
+ * Kept for existing callers of `add_callback()`; any other period can be
+ * requested with `add_callback_ms()`.
  */
 enum {
     TIMER_200ms, /**< 200 milliseconds timer. */
@@ -40,6 +86,31 @@ enum {
     TIMER_100ms  /**< 100 milliseconds timer. */
 };
 
+/** @brief Number of log2 buckets in the timer histograms. */
+#ifndef TIMER_HIST_BUCKETS
+#define TIMER_HIST_BUCKETS 20
+#endif
+
+/**
+ * @struct timer_stats_t
+ * @brief Jitter and overrun statistics of a timer (or of all timers).
+ *
+ * Histogram bucket 0 counts 0 us, bucket b counts [2^(b-1), 2^b) us and
+ * the last bucket everything above.
+ */
+typedef struct {
+    uint32_t lateness[TIMER_HIST_BUCKETS]; /**< Nominal expiry to dispatch, in us. */
+    uint32_t runtime[TIMER_HIST_BUCKETS]; /**< Callback run time (or time to post the event), in us. */
+    uint32_t fired; /**< Number of expiries dispatched. */
+    uint32_t skipped; /**< Periods skipped because the timer thread overran them. */
+    uint32_t dropped; /**< Time events lost to a full owner queue. */
+    uint32_t max_lateness_us; /**< Worst lateness seen. */
+    uint32_t max_runtime_us; /**< Worst run time seen. */
+} timer_stats_t;
+
+/** @brief Active Object receiving time events (see active_object.h). */
+struct base_obj;
+
 /**
  * @typedef timer_callback_t
  * @brief Function pointer type for timer callbacks.
@@ -58,25 +129,66 @@ typedef struct timer_callback_entry timer_callback_entry_t;
  * @brief Represents an individual timer callback entry.
  *
  * This structure stores information about registered timer callbacks,
- * including the callback function, context, and priority.
+ * including the callback function, context, and priority. Entries are
+ * taken from a fixed pool of TIMER_POOL_SIZE; none are allocated at runtime.
  */
 struct timer_callback_entry {
-	uint8_t timer_id; /**< Identifier for the associated timer. */
+	uint8_t timer_id; /**< Identifier for the associated timer (TIMER_CUSTOM for explicit periods). */
     uint8_t state; /**< Priority of the callback (higher executes first). */
     bool one_shot;
     timer_callback_t callback; /**< Function to be executed when the timer expires. */
-    pthread_mutex_t sem_entry;
     void *context;  /**< User-defined context data for the callback. */
     uint8_t priority; /**< Execution priority of the callback */
-    struct timer_callback_entry *next; /**< Pointer to the next callback entry */
+    struct timer_callback_entry *next; /**< Next free entry while the entry is in the pool */
+    uint16_t generation; /**< Bumped each time the entry returns to the pool. */
+    bool in_use; /**< Entry is allocated from the pool. */
+    bool transient; /**< One-shot started by handle; returns to the pool after firing. */
+
+    struct base_obj *owner; /**< Active Object receiving the time event, or NULL for a callback. */
+    uint32_t signal; /**< Signal posted to `owner` on expiry. */
+    bool urgent; /**< Post the time event ahead of the owner's queued messages. */
+
+    uint32_t period_ms; /**< Period (or one-shot delay) in milliseconds. */
+    uint64_t expires; /**< Absolute expiry tick while armed. */
+    uint32_t slack_ms; /**< Tolerated lateness used to coalesce wake-ups. */
+    uint64_t due_tick; /**< Nominal expiry of the batch the entry is firing in. */
+    timer_stats_t stats; /**< Jitter/overrun statistics since the entry was created. */
+    uint8_t level; /**< Wheel level holding the entry (0xFF when not linked). */
+    uint8_t slot; /**< Wheel slot holding the entry. */
+    bool firing; /**< Set while the entry sits in the timer thread's expiry batch. */
+    bool removed; /**< Removal requested while firing; freed by the timer thread. */
+    struct timer_callback_entry *wheel_prev; /**< Previous entry in the wheel slot. */
+    struct timer_callback_entry *wheel_next; /**< Next entry in the wheel slot. */
+    struct timer_callback_entry *due_next; /**< Next entry in the expiry batch. */
 };
 
+/**
+ * @struct timer_stats_entry_t
+ * @brief Statistics of one live timer, as returned by `timers_t::stats()`.
+ */
+typedef struct {
+    uint8_t timer_id; /**< Legacy timer id, or TIMER_CUSTOM. */
+    bool one_shot; /**< Timer fires once per arm. */
+    uint32_t period_ms; /**< Period (or one-shot delay) in milliseconds. */
+    uint32_t slack_ms; /**< Tolerated lateness in milliseconds. */
+    timer_callback_t callback; /**< Callback, or NULL for a time event. */
+    const char *owner; /**< Name of the Active Object receiving time events, or NULL. */
+    uint32_t signal; /**< Time event signal. */
+    timer_stats_t stats; /**< Collected statistics. */
+} timer_stats_entry_t;
+
 /**
  * @struct timers_t
  * @brief Manages system timers and registered callback functions.
  *
  * This structure provides function pointers to manage timers,
  * including adding, removing, arming, and disarming callbacks.
+ *
+ * All timers share one hierarchical timing wheel serviced by a single
+ * thread sleeping on a `timerfd`. Arming and disarming are O(1). The
+ * `timerfd` is programmed for the earliest expiry plus that timer's slack,
+ * and every timer due by then fires on the same wake-up; nothing wakes up
+ * while no timer is armed (tickless).
  */
 typedef struct {
     /**
@@ -93,6 +205,18 @@ typedef struct {
      */
     void (*disarm)(timer_callback_entry_t *entry);
 
+    /**
+     * @brief Sets how late a timer may fire (default TIMER_DEFAULT_SLACK_MS).
+     *
+     * The timer fires no earlier than its expiry and no later than its
+     * expiry plus @p slack_ms; within that window it is batched with other
+     * expiries. Periodic timers keep their nominal schedule regardless.
+     *
+     * @param entry Pointer to the timer callback entry.
+     * @param slack_ms Tolerated lateness in milliseconds (0 for exact).
+     */
+    void (*set_slack)(timer_callback_entry_t *entry, uint32_t slack_ms);
+
     /**
      * @brief Adds a new callback to a timer.
      *
@@ -105,6 +229,82 @@ typedef struct {
      */
     timer_callback_entry_t* (*add_callback)(uint8_t timer_id, timer_callback_t callback, void *context, uint8_t priority, bool one_shot);
 
+    /**
+     * @brief Adds a new callback with an arbitrary period.
+     *
+     * @param period_ms Period in milliseconds, or the delay before the single
+     *                  expiry when @p one_shot is set (1 .. TIMER_MAX_PERIOD_MS).
+     * @param callback Function to be executed when the timer expires.
+     * @param context Pointer to user-defined context.
+     * @param priority Priority among callbacks expiring on the same tick.
+     * @param one_shot Defines is the should only be executed once
+     * @return Pointer to the newly created TimerCallbackEntry.
+     */
+    timer_callback_entry_t* (*add_callback_ms)(uint32_t period_ms, timer_callback_t callback, void *context, uint8_t priority, bool one_shot);
+
+    /**
+     * @brief Adds a time event delivered to an Active Object.
+     *
+     * On expiry the timer thread posts a message carrying @p signal (with an
+     * empty payload) to @p owner instead of running user code, so the event
+     * is handled on the owner's thread like any other message. Posting never
+     * blocks: an expiry is dropped if the owner's queue is full.
+     *
+     * @param period_ms Period in milliseconds, or the delay before the single
+     *                  expiry when @p one_shot is set (1 .. TIMER_MAX_PERIOD_MS).
+     * @param owner Active Object receiving the event.
+     * @param signal Signal of the posted message.
+     * @param urgent Queue the event ahead of messages already waiting.
+     * @param one_shot Defines is the should only be executed once
+     * @return Pointer to the newly created TimerCallbackEntry.
+     */
+    timer_callback_entry_t* (*add_event)(uint32_t period_ms, struct base_obj *owner, uint32_t signal, bool urgent, bool one_shot);
+
+    /**
+     * @brief Starts a one-shot callback, e.g. a per-request timeout.
+     *
+     * The entry is taken from the pool, armed immediately, and returned to
+     * the pool once it has fired or been cancelled.
+     *
+     * @param delay_ms Delay before the callback runs (1 .. TIMER_MAX_PERIOD_MS).
+     * @param callback Function to be executed when the timer expires.
+     * @param context Pointer to user-defined context.
+     * @param priority Priority among callbacks expiring on the same tick.
+     * @return Handle for `cancel()`, or TIMER_HANDLE_INVALID if the pool is exhausted.
+     */
+    timer_handle_t (*oneshot)(uint32_t delay_ms, timer_callback_t callback, void *context, uint8_t priority);
+
+    /**
+     * @brief Starts a one-shot time event (see `add_event()`).
+     *
+     * @param delay_ms Delay before the event is posted (1 .. TIMER_MAX_PERIOD_MS).
+     * @param owner Active Object receiving the event.
+     * @param signal Signal of the posted message.
+     * @param urgent Queue the event ahead of messages already waiting.
+     * @return Handle for `cancel()`, or TIMER_HANDLE_INVALID if the pool is exhausted.
+     */
+    timer_handle_t (*oneshot_event)(uint32_t delay_ms, struct base_obj *owner, uint32_t signal, bool urgent);
+
+    /**
+     * @brief Cancels a timer and returns its entry to the pool in O(1).
+     *
+     * @param handle Handle returned by `oneshot()` or `oneshot_event()`.
+     * @return true if the timer was still pending, false if the handle is
+     *         stale (already fired or cancelled).
+     */
+    bool (*cancel)(timer_handle_t handle);
+
+    /**
+     * @brief Copies the statistics of every live timer.
+     *
+     * @param out Array receiving one record per timer.
+     * @param max Capacity of @p out.
+     * @param total If not NULL, receives the statistics summed over all
+     *              expiries, including one-shots already returned to the pool.
+     * @return Number of records written.
+     */
+    uint16_t (*stats)(timer_stats_entry_t *out, uint16_t max, timer_stats_t *total);
+
     /**
      * @brief Removes a callback from a timer.
      *
@@ -35,6 +35,10 @@ sys_id_t system_id __attribute__ ((section(".sys_id_section"))); /* Defined in l
 base_obj_t *active_objects[MAX_ACTIVE_OBJECTS] = { 0 };
 /** @brief Count of registered active objects. */
 int active_object_count = 0;
+#if defined(__linux__)
+/** @brief Serialises registry updates against active_object_snapshot(). */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 #ifdef _WIN32
     #include <windows.h>
@@ -72,6 +76,32 @@ static void MsgQueue_Push(MsgQueue_t *q, const message_frame_t *frame) {
     LeaveCriticalSection(&q->lock);
 }
 
+/**
+ * @brief Pushes a message frame into the queue unless it is full.
+ * @param q Pointer to the message queue.
+ * @param frame Pointer to the message frame to be added.
+ * @param urgent Non-zero to insert the frame at the head of the queue.
+ * @return 1 if the frame was queued, 0 otherwise.
+ */
+static uint8_t MsgQueue_TryPush(MsgQueue_t *q, const message_frame_t *frame, uint8_t urgent) {
+    uint8_t queued = 0;
+    EnterCriticalSection(&q->lock);
+    if (q->count < AO_QUEUE_SIZE) {
+        if (urgent) {
+            q->head = (q->head + AO_QUEUE_SIZE - 1) % AO_QUEUE_SIZE;
+            q->buffer[q->head] = *frame;
+        } else {
+            q->buffer[q->tail] = *frame;
+            q->tail = (q->tail + 1) % AO_QUEUE_SIZE;
+        }
+        q->count++;
+        queued = 1;
+        WakeConditionVariable(&q->cond);
+    }
+    LeaveCriticalSection(&q->lock);
+    return queued;
+}
+
 /**
  * @brief Pops a message frame from the queue.
  * @param q Pointer to the message queue.
@@ -114,6 +144,46 @@ void MsgQueue_Push(MsgQueue_t *q, const message_frame_t *m) {
 	sem_post(&q->items);
 }
 
+uint8_t MsgQueue_TryPush(MsgQueue_t *q, const message_frame_t *m, uint8_t urgent) {
+	if (sem_trywait(&q->slots) != 0) {
+		return 0; // full
+	}
+	pthread_mutex_lock(&q->lock);
+	if (urgent) {
+		q->head = (q->head + AO_QUEUE_SIZE - 1) % AO_QUEUE_SIZE;
+		q->buf[q->head] = *m;
+	} else {
+		q->buf[q->tail] = *m;
+		q->tail = (q->tail + 1) % AO_QUEUE_SIZE;
+	}
+	q->count++;
+	pthread_mutex_unlock(&q->lock);
+	sem_post(&q->items);
+	return 1;
+}
+
+uint8_t MsgQueue_TimedPush(MsgQueue_t *q, const message_frame_t *m, uint32_t timeout_ms) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	while (sem_timedwait(&q->slots, &ts) != 0) {
+		if (errno != EINTR)
+			return 0; // still full
+	}
+	pthread_mutex_lock(&q->lock);
+	q->buf[q->tail] = *m;
+	q->tail = (q->tail + 1) % AO_QUEUE_SIZE;
+	q->count++;
+	pthread_mutex_unlock(&q->lock);
+	sem_post(&q->items);
+	return 1;
+}
+
 uint8_t MsgQueue_Pop(MsgQueue_t *q, message_frame_t *out) {
 
 	int success = 0;
@@ -171,7 +241,9 @@ static void event_loop(void *vparam);
  * @brief Starts the Active Object.
  *
  * This function initializes the message queue and creates a thread/task
- * to handle incoming events.
+ * to handle incoming events. The new thread runs fsm_init() before it
+ * reports ready, so the initial transition (and anything its entry actions
+ * post internally) completes on the AO thread before start() returns.
  *
  * @param me Pointer to the Active Object instance.
  */
@@ -183,7 +255,6 @@ void start(base_obj_t *const me) {
 		if (me->thread_id != NULL) {
 			me->vptr->log(me, (const uint8_t*) "ActiveObject started (Windows).", sizeof("ActiveObject started (Windows)."));
 			register_active_object(me);
-			fsm_init(&me->fsm, me->initialisation_state);
 		}else{
 			me->vptr->log(me, (const uint8_t*) "ActiveObject not started (Windows).", sizeof("ActiveObject not started (Windows)."));
 		}
@@ -192,11 +263,11 @@ void start(base_obj_t *const me) {
 	if (me->thread_id == 0) {
 		pthread_mutex_init(&me->sem_log, NULL);
 		if (pthread_create(&me->thread_id, NULL, event_loop, me) == 0) {
-			while (!me->ready)
+			while (!__atomic_load_n(&me->ready, __ATOMIC_ACQUIRE))
 				;
 			me->vptr->log(me, (const uint8_t*) "ActiveObject started (Linux).",
 					sizeof("ActiveObject started (Linux)."));
-			fsm_init(&me->fsm, me->initialisation_state);
+			register_active_object(me);
 		} else {
 			me->vptr->log(me,
 					(const uint8_t*) "ActiveObject not started (Linux).",
@@ -211,7 +282,6 @@ void start(base_obj_t *const me) {
 		if (me->thread_id != NULL) {
 			me->vptr->log(me, (const uint8_t*) "ActiveObject started (FreeRTOS).", sizeof("ActiveObject started (FreeRTOS)."));
 			register_active_object(me);
-			fsm_init(&me->fsm, me->initialisation_state);
 		} else {
 			me->vptr->log(me, (const uint8_t*) "ActiveObject not started (FreeRTOS).", sizeof("ActiveObject not started (FreeRTOS)."));
 		}
@@ -278,6 +348,49 @@ void post(base_obj_t *const me, const message_frame_t frame) {
 #endif
 }
 
+/**
+ * @brief Posts a message to the Active Object without blocking.
+ *
+ * @param me Pointer to the Active Object instance.
+ * @param frame Pointer to the message frame to be added to the queue.
+ * @param urgent Non-zero to queue the message at the front.
+ * @return 1 if the message was queued, 0 if the queue was full.
+ */
+uint8_t try_post(base_obj_t *const me, const message_frame_t *frame, uint8_t urgent) {
+#if defined (_WIN32) || defined (__linux__)
+	return MsgQueue_TryPush(&me->msgQueue, frame, urgent);
+#else
+	if (!me->msg_queue_id) {
+		return 0;
+	}
+	return (urgent ? xQueueSendToFront(me->msg_queue_id, frame, 0) :
+			xQueueSendToBack(me->msg_queue_id, frame, 0)) == pdTRUE;
+#endif
+}
+
+/**
+ * @brief Posts a message to the Active Object, waiting a bounded time for
+ *        room in the queue.
+ *
+ * @param me Pointer to the Active Object instance.
+ * @param frame Pointer to the message frame to be added to the queue.
+ * @param timeout_ms Longest wait for a free slot, in milliseconds.
+ * @return 1 if the message was queued, 0 if the queue stayed full.
+ */
+uint8_t post_timeout(base_obj_t *const me, const message_frame_t *frame, uint32_t timeout_ms) {
+#if defined (_WIN32)
+	(void) timeout_ms; // the Windows queue never blocks a producer
+	return MsgQueue_TryPush(&me->msgQueue, frame, 0);
+#elif defined (__linux__)
+	return MsgQueue_TimedPush(&me->msgQueue, frame, timeout_ms);
+#else
+	if (!me->msg_queue_id) {
+		return 0;
+	}
+	return xQueueSendToBack(me->msg_queue_id, frame, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+#endif
+}
+
 /**
  * @brief Dispatches a received message frame.
  * @param me Pointer to the Active Object instance.
@@ -354,6 +467,9 @@ void ao_ctor(base_obj_t *const me, broker_t *broker, const char *name) {
  *       are properly tracked.
  */
 void register_active_object(base_obj_t *me) {
+#if defined(__linux__)
+	pthread_mutex_lock(&registry_lock);
+#endif
 	if (active_object_count < MAX_ACTIVE_OBJECTS) {
 		active_objects[active_object_count++] = me;
 	} else {
@@ -361,6 +477,9 @@ void register_active_object(base_obj_t *me) {
         printf("Error: Maximum number of ActiveObjects reached.\n");
 #endif
 	}
+#if defined(__linux__)
+	pthread_mutex_unlock(&registry_lock);
+#endif
 }
 
 /**
@@ -375,13 +494,42 @@ void register_active_object(base_obj_t *me) {
  *       an accurate object registry.
  */
 void unregister_active_object(const base_obj_t *me) {
+#if defined(__linux__)
+	pthread_mutex_lock(&registry_lock);
+#endif
 	for (int i = 0; i < active_object_count; i++) {
 		if (active_objects[i] == me) {
-			active_objects[i] = NULL;  // Replace with last entry
 			active_object_count--;
-			return;
+			active_objects[i] = active_objects[active_object_count]; // Replace with last entry
+			active_objects[active_object_count] = NULL;
+			break;
 		}
 	}
+#if defined(__linux__)
+	pthread_mutex_unlock(&registry_lock);
+#endif
+}
+
+/**
+ * @brief Copies the registry for use outside the registering threads.
+ *
+ * The copy is taken under the registry lock, so a reader on another thread
+ * (e.g. the web server) sees a consistent list while AOs start and stop.
+ *
+ * @param out Destination array.
+ * @param max Capacity of @p out in entries.
+ * @return Number of entries written to @p out.
+ */
+int active_object_snapshot(base_obj_t **out, int max) {
+#if defined(__linux__)
+	pthread_mutex_lock(&registry_lock);
+#endif
+	int n = active_object_count < max ? active_object_count : max;
+	memcpy(out, active_objects, (size_t) n * sizeof(out[0]));
+#if defined(__linux__)
+	pthread_mutex_unlock(&registry_lock);
+#endif
+	return n;
 }
 
 #ifdef _WIN32
@@ -398,6 +546,8 @@ void unregister_active_object(const base_obj_t *me) {
 unsigned __stdcall event_loop(void *vparam) {
     base_obj_t *me = (base_obj_t*) vparam;
     message_frame_t event;
+    fsm_init(&me->fsm, me->initialisation_state);
+    me->ready = 1;
 
     while (1) {
         if (MsgQueue_Pop(&me->msgQueue, &event)) {
@@ -417,7 +567,11 @@ unsigned __stdcall event_loop(void *vparam) {
 static void* event_loop(void *vparam) {
 	base_obj_t *me = (base_obj_t*) vparam;
 	message_frame_t event;
-	me->ready = 1;
+	/* run the initial transition on this thread: entry actions may start
+	 * other threads that post to us, and fsm_post_internal() is only
+	 * valid on the thread that runs the FSM */
+	fsm_init(&me->fsm, me->initialisation_state);
+	__atomic_store_n(&me->ready, 1, __ATOMIC_RELEASE);
 	(void) me;
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
@@ -447,6 +601,8 @@ static void event_loop(void *vparam) {
 	base_obj_t *me = (base_obj_t*) vparam;
 	message_frame_t event;
 	if (me != NULL) {
+		fsm_init(&me->fsm, me->initialisation_state);
+		me->ready = 1;
 		while (1) {
 			if (xQueueReceive(me->msg_queue_id, &event, portMAX_DELAY) == pdTRUE) {
 				if (me->vptr && me->vptr->dispatch) {
@@ -238,7 +238,8 @@ broker_t* broker_ctor(void) {
 	if (broker.primary_thread_id == 0 && broker.secondary_thread_id == 0) {
 		pthread_create(&broker.primary_thread_id, NULL, Broker_PrimaryTask, &broker);
 		pthread_create(&broker.secondary_thread_id, NULL, Broker_SecondaryTask, &broker);
-		while(!(broker.broker1_ready & broker.broker2_ready));
+		while (!(__atomic_load_n(&broker.broker1_ready, __ATOMIC_ACQUIRE)
+				& __atomic_load_n(&broker.broker2_ready, __ATOMIC_ACQUIRE)));
 #else
 	if (broker.primary_thread_id == NULL && broker.secondary_thread_id == NULL) {
 		broker.sem_handle = xSemaphoreCreateMutex();
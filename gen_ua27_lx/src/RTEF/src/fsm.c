@@ -19,6 +19,39 @@ extern "C" {
 #include <stddef.h>
 #include <fsm.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#elif defined (__linux__)
+#include <time.h>
+#else
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
+
+static void fsm_process(fsm_t *fsm, const message_frame_t *event);
+static void fsm_drain_internal(fsm_t *fsm);
+static void fsm_trace_record(fsm_trace_t *trace, uint32_t signal,
+		const state_t *state, const state_t *next_state, uint64_t t0);
+
+/**
+ * @brief Monotonic time source for the trace ring, in microseconds.
+ * @return The current monotonic time in microseconds.
+ */
+static uint64_t fsm_time_us(void) {
+#ifdef _WIN32
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t) ((double) counter.QuadPart * 1000000.0 / freq.QuadPart);
+#elif defined (__linux__)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+#else
+	return (uint64_t) xTaskGetTickCount() * portTICK_PERIOD_MS * 1000ULL;
+#endif
+}
+
 /**
  * @brief Initializes the FSM with an initial state.
  *
@@ -36,6 +69,9 @@ void fsm_init(fsm_t *fsm, state_t *initial) {
 		if (fsm->current_state->on_entry) {
 			fsm->current_state->on_entry(fsm);
 		}
+
+		/* Run events posted by the entry action to completion */
+		fsm_drain_internal(fsm);
 	}
 }
 
@@ -56,6 +92,60 @@ void fsm_handler(fsm_t *fsm, const message_frame_t *event) {
 	if (!fsm->current_state)
 		return;
 
+	fsm_process(fsm, event);
+	fsm_drain_internal(fsm);
+}
+
+/**
+ * @brief Posts an event to the FSM's own internal queue.
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param event Pointer to the event to be queued (copied).
+ * @return 1 if the event was queued, 0 if the internal queue is full.
+ */
+uint8_t fsm_post_internal(fsm_t *fsm, const message_frame_t *event) {
+	if (fsm->internal.count >= FSM_INTERNAL_QUEUE_SIZE)
+		return 0;
+
+	fsm->internal.buf[fsm->internal.tail] = *event;
+	fsm->internal.tail = (uint8_t) ((fsm->internal.tail + 1) % FSM_INTERNAL_QUEUE_SIZE);
+	fsm->internal.count++;
+	return 1;
+}
+
+/**
+ * @brief Processes every pending internal event in FIFO order.
+ *
+ * Events posted while draining (e.g. by the entry action of the state just
+ * entered) are appended to the same queue and processed in this loop.
+ *
+ * @param fsm Pointer to the FSM instance.
+ */
+static void fsm_drain_internal(fsm_t *fsm) {
+	message_frame_t event;
+
+	while (fsm->internal.count > 0) {
+		event = fsm->internal.buf[fsm->internal.head];
+		fsm->internal.head = (uint8_t) ((fsm->internal.head + 1) % FSM_INTERNAL_QUEUE_SIZE);
+		fsm->internal.count--;
+		fsm_process(fsm, &event);
+	}
+}
+
+/**
+ * @brief Runs a single event through the current state's jump table/handler.
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param event Pointer to the event to be processed.
+ */
+static void fsm_process(fsm_t *fsm, const message_frame_t *event) {
+	if (!fsm->current_state)
+		return;
+
+	state_t *state = fsm->current_state;
+	const state_t *next_state = NULL;
+	uint64_t t0 = fsm->trace ? fsm_time_us() : 0;
+
 	/* Search jump table for matching signal */
 	for (uint8_t i = 0; i < fsm->current_state->transition_count; i++) {
 		transition_t *t = &fsm->current_state->transitions[i];
@@ -72,6 +162,7 @@ void fsm_handler(fsm_t *fsm, const message_frame_t *event) {
 
 			/* Change state */
 			fsm->current_state = t->next_state;
+			next_state = t->next_state;
 
 			/* Call entry action */
 			if (fsm->current_state->on_entry) {
@@ -86,6 +177,91 @@ void fsm_handler(fsm_t *fsm, const message_frame_t *event) {
 	if (fsm->current_state->handler) {
 		fsm->current_state->handler(fsm, event);
 	}
+
+	if (fsm->trace) {
+		fsm_trace_record(fsm->trace, event->signal, state, next_state, t0);
+	}
+}
+
+/**
+ * @brief Appends one record to the trace ring.
+ *
+ * Each entry carries its own sequence number: odd while it is being
+ * written, even (and unique per lap of the ring) once complete, so that
+ * readers can detect torn copies without taking a lock.
+ *
+ * @param trace Pointer to the trace ring.
+ * @param signal Signal of the processed event.
+ * @param state State the event was delivered to.
+ * @param next_state Target state of the transition taken, or NULL.
+ * @param t0 Time at which processing started (microseconds).
+ */
+static void fsm_trace_record(fsm_trace_t *trace, uint32_t signal,
+		const state_t *state, const state_t *next_state, uint64_t t0) {
+	uint32_t head = trace->head;
+	fsm_trace_entry_t *e = &trace->entries[head & (FSM_TRACE_LEN - 1)];
+	uint64_t t1 = fsm_time_us();
+
+	__atomic_store_n(&e->seq, head * 2u + 1u, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	e->signal = signal;
+	e->timestamp_us = t0;
+	e->state = state;
+	e->next_state = next_state;
+	e->duration_us = (uint32_t) (t1 - t0);
+	__atomic_store_n(&e->seq, head * 2u + 2u, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace->head, head + 1u, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Attaches a trace ring to the FSM (or detaches it with NULL).
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param trace Pointer to the trace ring storage, or NULL to disable tracing.
+ */
+void fsm_trace_enable(fsm_t *fsm, fsm_trace_t *trace) {
+	if (trace != NULL) {
+		trace->head = 0;
+		for (uint16_t i = 0; i < FSM_TRACE_LEN; i++) {
+			trace->entries[i].seq = 0;
+		}
+	}
+	fsm->trace = trace;
+}
+
+/**
+ * @brief Copies the most recent trace records, oldest first.
+ *
+ * @param fsm Pointer to the FSM instance.
+ * @param out Destination array.
+ * @param max Capacity of @p out in entries.
+ * @return Number of entries copied (0 if tracing is disabled).
+ */
+uint16_t fsm_trace_snapshot(const fsm_t *fsm, fsm_trace_entry_t *out, uint16_t max) {
+	const fsm_trace_t *trace = fsm->trace;
+	uint16_t n = 0;
+
+	if (trace == NULL || out == NULL)
+		return 0;
+
+	uint32_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+	uint32_t span = head < FSM_TRACE_LEN ? head : FSM_TRACE_LEN;
+	if (span > max)
+		span = max;
+
+	for (uint32_t i = head - span; i != head; i++) {
+		const fsm_trace_entry_t *e = &trace->entries[i & (FSM_TRACE_LEN - 1)];
+		uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq != i * 2u + 2u)
+			continue; /* being written or already overwritten */
+
+		out[n] = *e;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq)
+			continue; /* torn copy */
+		n++;
+	}
+	return n;
 }
 
 #ifdef __cplusplus
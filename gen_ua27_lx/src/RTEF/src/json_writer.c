@@ -0,0 +1,283 @@
+/**
+ * @file json_writer.c
+ * @brief Implements the streaming JSON writer.
+ *
+ * Every value goes through value_prefix(), which writes the separating comma
+ * when the enclosing container already has a member; the per-depth "has a
+ * member" flags live in one bitmask so nesting costs no memory. Strings are
+ * copied in runs between characters that need escaping, and integers are
+ * formatted by hand; only non-integral doubles go through snprintf().
+ *
+ * Once the writer fails (fixed buffer full, allocation failure, nesting too
+ * deep or unbalanced) every further call is a no-op and json_writer_finish()
+ * returns NULL, so callers check once at the end.
+ *
+ * @author Nathan Ikolo
+ * @date October 18, 2026
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <json_writer.h>
+
+/**
+ * @brief Make room for @p n more bytes plus the terminating NUL.
+ *
+ * @return true if the bytes fit, false (and the writer failed) otherwise.
+ */
+static bool reserve(json_writer_t *w, size_t n) {
+	if (w->failed)
+		return false;
+	if (w->len + n < w->cap)
+		return true;
+	if (!w->growable) {
+		w->failed = 1;
+		return false;
+	}
+	size_t cap = w->cap;
+	while (w->len + n >= cap)
+		cap *= 2;
+	char *p = realloc(w->buf, cap);
+	if (!p) {
+		w->failed = 1;
+		return false;
+	}
+	w->buf = p;
+	w->cap = cap;
+	return true;
+}
+
+static void put(json_writer_t *w, const char *s, size_t n) {
+	if (!reserve(w, n))
+		return;
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+	w->buf[w->len] = '\0';
+}
+
+static void put_char(json_writer_t *w, char c) {
+	if (!reserve(w, 1))
+		return;
+	w->buf[w->len++] = c;
+	w->buf[w->len] = '\0';
+}
+
+/** @brief Write the comma separating this value from the previous member. */
+static void value_prefix(json_writer_t *w) {
+	if (w->after_key) {
+		w->after_key = 0;
+		return;
+	}
+	uint32_t bit = 1U << w->depth;
+	if (w->more & bit)
+		put_char(w, ',');
+	w->more |= bit;
+}
+
+static void container_open(json_writer_t *w, char c) {
+	value_prefix(w);
+	if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+		w->failed = 1;
+		return;
+	}
+	put_char(w, c);
+	w->depth++;
+	w->more &= ~(1U << w->depth);
+}
+
+static void container_close(json_writer_t *w, char c) {
+	if (w->depth == 0 || w->after_key) {
+		w->failed = 1;
+		return;
+	}
+	w->depth--;
+	put_char(w, c);
+}
+
+static void put_string(json_writer_t *w, const char *s, size_t n) {
+	static const char hex[] = "0123456789abcdef";
+	put_char(w, '"');
+	size_t run = 0;
+	for (size_t i = 0; i < n; i++) {
+		unsigned char c = (unsigned char) s[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		put(w, s + run, i - run);
+		run = i + 1;
+		char e[6] = { '\\', 0 };
+		size_t elen = 2;
+		switch (c) {
+		case '"':
+		case '\\':
+			e[1] = (char) c;
+			break;
+		case '\b':
+			e[1] = 'b';
+			break;
+		case '\f':
+			e[1] = 'f';
+			break;
+		case '\n':
+			e[1] = 'n';
+			break;
+		case '\r':
+			e[1] = 'r';
+			break;
+		case '\t':
+			e[1] = 't';
+			break;
+		default:
+			e[1] = 'u';
+			e[2] = '0';
+			e[3] = '0';
+			e[4] = hex[c >> 4];
+			e[5] = hex[c & 0xF];
+			elen = 6;
+			break;
+		}
+		put(w, e, elen);
+	}
+	put(w, s + run, n - run);
+	put_char(w, '"');
+}
+
+static void put_uint(json_writer_t *w, uint64_t v, bool neg) {
+	char d[21];
+	size_t i = sizeof(d);
+	do {
+		d[--i] = (char) ('0' + v % 10);
+		v /= 10;
+	} while (v);
+	if (neg)
+		d[--i] = '-';
+	put(w, d + i, sizeof(d) - i);
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap) {
+	memset(w, 0, sizeof(*w));
+	w->buf = buf;
+	w->cap = cap;
+	if (cap)
+		buf[0] = '\0';
+	else
+		w->failed = 1;
+}
+
+bool json_writer_init_dynamic(json_writer_t *w, size_t initial) {
+	memset(w, 0, sizeof(*w));
+	w->cap = initial ? initial : 64;
+	w->buf = malloc(w->cap);
+	if (!w->buf) {
+		w->failed = 1;
+		return false;
+	}
+	w->buf[0] = '\0';
+	w->growable = 1;
+	return true;
+}
+
+char* json_writer_finish(json_writer_t *w, size_t *len) {
+	if (w->depth || w->after_key)
+		w->failed = 1;
+	if (w->failed) {
+		if (w->growable)
+			free(w->buf);
+		w->buf = NULL;
+		return NULL;
+	}
+	if (len)
+		*len = w->len;
+	return w->buf;
+}
+
+void json_object_begin(json_writer_t *w) {
+	container_open(w, '{');
+}
+
+void json_object_end(json_writer_t *w) {
+	container_close(w, '}');
+}
+
+void json_array_begin(json_writer_t *w) {
+	container_open(w, '[');
+}
+
+void json_array_end(json_writer_t *w) {
+	container_close(w, ']');
+}
+
+void json_key(json_writer_t *w, const char *key) {
+	value_prefix(w);
+	put_string(w, key, strlen(key));
+	put_char(w, ':');
+	w->after_key = 1;
+}
+
+void json_string(json_writer_t *w, const char *s) {
+	if (!s) {
+		json_null(w);
+		return;
+	}
+	json_string_n(w, s, strlen(s));
+}
+
+void json_string_n(json_writer_t *w, const char *s, size_t n) {
+	value_prefix(w);
+	put_string(w, s, n);
+}
+
+void json_int(json_writer_t *w, int64_t v) {
+	value_prefix(w);
+	put_uint(w, v < 0 ? 0 - (uint64_t) v : (uint64_t) v, v < 0);
+}
+
+void json_uint(json_writer_t *w, uint64_t v) {
+	value_prefix(w);
+	put_uint(w, v, false);
+}
+
+void json_double(json_writer_t *w, double v) {
+	if (!isfinite(v)) {
+		json_null(w);
+		return;
+	}
+	if (fabs(v) < 1e15 && v == (double) (int64_t) v) {
+		json_int(w, (int64_t) v);
+		return;
+	}
+	/* shortest of %.15g / %.17g that reads back exactly, like cJSON */
+	char d[32];
+	int n = snprintf(d, sizeof(d), "%1.15g", v);
+	if (strtod(d, NULL) != v)
+		n = snprintf(d, sizeof(d), "%1.17g", v);
+	value_prefix(w);
+	put(w, d, (size_t) n);
+}
+
+void json_bool(json_writer_t *w, bool v) {
+	value_prefix(w);
+	if (v)
+		put(w, "true", 4);
+	else
+		put(w, "false", 5);
+}
+
+void json_null(json_writer_t *w) {
+	value_prefix(w);
+	put(w, "null", 4);
+}
+
+void json_raw(json_writer_t *w, const char *json, size_t n) {
+	value_prefix(w);
+	put(w, json, n);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,10 +3,27 @@
  * @brief Implements a system timer manager for scheduling timed callbacks.
  *
  * This file provides an implementation for system timers. The system allows
- * registering callbacks with different timer periods and priority levels.
+ * registering callbacks with arbitrary periods (or one-shot delays) and
+ * priority levels.
  *
- * It manages multiple timers and ensures proper execution of registered callback
- * functions while maintaining synchronization between tasks.
+ * All callbacks share a single hierarchical timing wheel with a resolution
+ * of TIMER_TICK_MS. Level L holds entries expiring between 64^L and
+ * 64^(L+1) ticks ahead, one slot per 64^L ticks; an entry is moved down a
+ * level when the wheel reaches the start of its slot. A per-level occupancy
+ * bitmap finds occupied slots without scanning empty ones. The single timer
+ * thread sleeps on a `timerfd` armed for the earliest expiry plus its slack;
+ * cascades need no wake-up of their own since advancing the wheel replays
+ * every slot boundary it passes. With nothing armed the `timerfd` is disarmed.
+ *
+ * An entry either runs a callback on the timer thread or, as a time event,
+ * posts a signal to its owning Active Object so the expiry is handled on
+ * that object's thread. Entries come from a preallocated pool, so per-request
+ * timeouts started with oneshot() cost no allocation and are cancelled in
+ * O(1) through their generation-counted handle.
+ *
+ * Every dispatch records how late it ran against the nominal expiry and how
+ * long the callback took into per-timer log2 histograms (see stats()), and
+ * periods skipped after an overrun are counted rather than silently lost.
  *
  * @author Nathan Ikolo
  * @date February 24, 2025
@@ -16,9 +33,10 @@
 extern "C" {
 #endif
 
-#include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <sys_timer.h>
+#include "active_object.h"
 
 /**
  * @enum timer_state_t
@@ -33,50 +51,97 @@ typedef enum {
 #define TIMER_PERIOD_100MS 100
 #define TIMER_PERIOD_200MS 200
 
+#define WHEEL_SIZE     (1u << TIMER_WHEEL_BITS)
+#define WHEEL_MASK     (WHEEL_SIZE - 1u)
+#define WHEEL_UNLINKED 0xFF
+#define WHEEL_IDLE     UINT64_MAX
+
 typedef struct {
 	pthread_t handle;
 	pthread_mutex_t lock;
-	pthread_cond_t cv;
-	uint32_t armed_count;
+	int tfd; /**< timerfd programmed for the next expiry. */
 	bool stop;
-	timer_callback_entry_t *callbackList;
-} timer_manager_t;
-
-static inline void add_ms(struct timespec *t, uint32_t ms);
-/** @brief Array of timer managers, one for each timer type. */
-static timer_manager_t timer_manager[MAX_TIMERS];
+	struct timespec epoch; /**< CLOCK_MONOTONIC instant of tick 0. */
+	uint64_t now; /**< Tick the wheel has been advanced to. */
+	uint64_t deadline; /**< Tick the timerfd is armed for (WHEEL_IDLE if none). */
+	uint64_t occupied[TIMER_WHEEL_LEVELS]; /**< Non-empty slots per level. */
+	timer_callback_entry_t *slots[TIMER_WHEEL_LEVELS][WHEEL_SIZE];
+	timer_callback_entry_t pool[TIMER_POOL_SIZE]; /**< Backing store for every entry. */
+	timer_callback_entry_t *free_list; /**< Unused pool entries. */
+	timer_stats_t total; /**< Statistics over every expiry. */
+} timer_wheel_t;
+
+/** @brief The timing wheel shared by every timer user. */
+static timer_wheel_t wheel = { .tfd = -1 };
 
 static void arm(timer_callback_entry_t *entry);
 static void disarm(timer_callback_entry_t *entry);
-static void timer_manager_init(void);
+static void set_slack(timer_callback_entry_t *entry, uint32_t slack_ms);
+static bool timer_manager_init(void);
 static timer_callback_entry_t* timer_manager_add_callback(uint8_t timer_id,
 		timer_callback_t callback, void *context, uint8_t priority,
 		bool one_shot);
+static timer_callback_entry_t* timer_manager_add_callback_ms(
+		uint32_t period_ms, timer_callback_t callback, void *context,
+		uint8_t priority, bool one_shot);
+static timer_callback_entry_t* timer_manager_add_event(uint32_t period_ms,
+		base_obj_t *owner, uint32_t signal, bool urgent, bool one_shot);
+static timer_handle_t timer_manager_oneshot(uint32_t delay_ms,
+		timer_callback_t callback, void *context, uint8_t priority);
+static timer_handle_t timer_manager_oneshot_event(uint32_t delay_ms,
+		base_obj_t *owner, uint32_t signal, bool urgent);
+static bool timer_manager_cancel(timer_handle_t handle);
+static uint16_t timer_manager_stats(timer_stats_entry_t *out, uint16_t max,
+		timer_stats_t *total);
 static void timer_manager_remove_callback(uint8_t timer_id,
 		timer_callback_t callback);
+static timer_callback_entry_t* timer_entry_new(uint32_t period_ms,
+		timer_callback_t callback, void *context, uint8_t priority,
+		base_obj_t *owner, uint32_t signal, bool urgent, bool one_shot);
+static timer_callback_entry_t* pool_acquire(timer_wheel_t *w);
+static void pool_release(timer_wheel_t *w, timer_callback_entry_t *e);
+static inline timer_handle_t pool_handle(const timer_wheel_t *w,
+		const timer_callback_entry_t *e);
+static void wheel_arm(timer_wheel_t *w, timer_callback_entry_t *e);
 static void* timer_thread(void *arg);
 static inline uint32_t timer_period_ms(uint8_t timer_id);
+static uint64_t wheel_ticks(const timer_wheel_t *w);
+static uint64_t wheel_us(const timer_wheel_t *w);
+static void stats_record(timer_stats_t *stats, uint32_t late_us,
+		uint32_t run_us, bool dropped);
+static void wheel_link(timer_wheel_t *w, timer_callback_entry_t *e);
+static void wheel_unlink(timer_wheel_t *w, timer_callback_entry_t *e);
+static uint64_t wheel_next_expiry(const timer_wheel_t *w);
+static uint64_t wheel_next_deadline(const timer_wheel_t *w);
+static void wheel_program(timer_wheel_t *w, uint64_t tick);
+static void wheel_queue_due(timer_callback_entry_t **due,
+		timer_callback_entry_t *e);
+static timer_callback_entry_t* wheel_advance(timer_wheel_t *w, uint64_t to);
 
 /**
  * @brief Constructs a system timer manager.
  *
  * This function initializes and returns a timer manager instance.
- * Depending on the `type` parameter, it can either be an RTOS timer
- * or a hardware-based timer (not yet supported).
+ * The timing wheel and its thread are created on the first call.
  *
- * @param type The type of timer to initialize.
  * @return Pointer to the created `timers_t` instance, or `NULL` if failed.
  */
 timers_t* timer_ctor() {
-	static timers_t timer = { .arm = arm, .disarm = disarm, .add_callback =
-			timer_manager_add_callback, .remove_callback =
-			timer_manager_remove_callback };
-	if (timer_manager[0].handle == 0 && timer_manager[1].handle == 0
-			&& timer_manager[2].handle == 0) {
-
-		timer_manager_init();
-	}
-	return &timer;
+	static timers_t timer = { .arm = arm, .disarm = disarm, .set_slack =
+			set_slack, .add_callback =
+			timer_manager_add_callback, .add_callback_ms =
+			timer_manager_add_callback_ms, .add_event = timer_manager_add_event,
+			.oneshot = timer_manager_oneshot, .oneshot_event =
+			timer_manager_oneshot_event, .cancel = timer_manager_cancel,
+			.stats = timer_manager_stats,
+			.remove_callback = timer_manager_remove_callback };
+	static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+	bool ok;
+
+	pthread_mutex_lock(&init_lock);
+	ok = (wheel.tfd >= 0) || timer_manager_init();
+	pthread_mutex_unlock(&init_lock);
+	return ok ? &timer : NULL;
 }
 
 uint32_t timer_period_ms(uint8_t timer_id) {
@@ -92,179 +157,608 @@ uint32_t timer_period_ms(uint8_t timer_id) {
 	}
 }
 
-void timer_manager_init(void) {
-	for (uint8_t i = 0; i < MAX_TIMERS; ++i) {
-		timer_manager[i].callbackList = NULL;
-		timer_manager[i].armed_count = 0;
-		timer_manager[i].stop = 0;
+bool timer_manager_init(void) {
+	timer_wheel_t *w = &wheel;
+
+	memset(w->occupied, 0, sizeof(w->occupied));
+	memset(w->slots, 0, sizeof(w->slots));
+	memset(w->pool, 0, sizeof(w->pool));
+	memset(&w->total, 0, sizeof(w->total));
+	w->free_list = NULL;
+	for (int i = TIMER_POOL_SIZE - 1; i >= 0; --i) {
+		w->pool[i].next = w->free_list;
+		w->free_list = &w->pool[i];
+	}
+	w->stop = false;
+	w->now = 0;
+	w->deadline = WHEEL_IDLE;
+	clock_gettime(CLOCK_MONOTONIC, &w->epoch);
+	pthread_mutex_init(&w->lock, NULL);
+
+	w->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (w->tfd < 0) {
+		return false;
+	}
+	if (pthread_create(&w->handle, NULL, timer_thread, w) != 0) {
+		close(w->tfd);
+		w->tfd = -1;
+		return false;
+	}
+	return true;
+}
 
-		pthread_mutex_init(&timer_manager[i].lock, NULL);
-		pthread_cond_init(&timer_manager[i].cv, NULL);
+/**
+ * @brief Takes an entry from the pool. Caller holds `w->lock`.
+ */
+timer_callback_entry_t* pool_acquire(timer_wheel_t *w) {
+	timer_callback_entry_t *e = w->free_list;
+	if (!e) {
+		return NULL;
+	}
+	w->free_list = e->next;
+
+	uint16_t generation = e->generation;
+	memset(e, 0, sizeof(*e));
+	e->generation = generation;
+	e->in_use = true;
+	e->state = DISARM;
+	e->level = WHEEL_UNLINKED;
+	return e;
+}
 
-		if (pthread_create(&timer_manager[i].handle, NULL, timer_thread,
-				(void*) (uintptr_t) i) != 0) {
-			// If creation fails, mark as stopped so other APIs can guard
-			timer_manager[i].stop = 1;
-			timer_manager[i].handle = (pthread_t) 0;
-		}
+/**
+ * @brief Returns an entry to the pool, invalidating its handles.
+ *
+ * An entry still in the timer thread's expiry batch is only flagged;
+ * the timer thread releases it once the batch is done.
+ * Caller holds `w->lock` and has unlinked the entry from the wheel.
+ */
+void pool_release(timer_wheel_t *w, timer_callback_entry_t *e) {
+	e->state = DISARM;
+	if (e->firing) {
+		e->removed = true;
+		return;
 	}
+	e->generation++;
+	e->in_use = false;
+	e->removed = false;
+	e->next = w->free_list;
+	w->free_list = e;
 }
 
-void add_ms(struct timespec *t, uint32_t ms) {
-	t->tv_nsec += (long) (ms % 1000) * 1000000L;
-	t->tv_sec += (time_t) (ms / 1000) + (t->tv_nsec / 1000000000L);
-	t->tv_nsec %= 1000000000L;
+timer_handle_t pool_handle(const timer_wheel_t *w,
+		const timer_callback_entry_t *e) {
+	return ((timer_handle_t) e->generation << 16)
+			| (timer_handle_t) (e - w->pool + 1);
 }
 
-void* timer_thread(void *arg) {
-	uint8_t id = (uint8_t) (uintptr_t) arg;
-	timer_manager_t *m = &timer_manager[id];
-	const uint32_t period = timer_period_ms(id);
+/**
+ * @brief Microseconds elapsed since the wheel epoch.
+ */
+uint64_t wheel_us(const timer_wheel_t *w) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t ns = (int64_t) (now.tv_sec - w->epoch.tv_sec) * 1000000000LL
+			+ (now.tv_nsec - w->epoch.tv_nsec);
+	return (uint64_t) ns / 1000ULL;
+}
 
-	pthread_mutex_lock(&m->lock);
-	// Park until at least one callback is armed
-	while (!m->stop && m->armed_count == 0)
-		pthread_cond_wait(&m->cv, &m->lock);
+/**
+ * @brief Milliseconds elapsed since the wheel epoch.
+ */
+uint64_t wheel_ticks(const timer_wheel_t *w) {
+	return wheel_us(w) / (1000ULL * TIMER_TICK_MS);
+}
 
-	struct timespec next;
-	clock_gettime(CLOCK_MONOTONIC, &next);
+/**
+ * @brief Adds one dispatch to a statistics block.
+ */
+void stats_record(timer_stats_t *stats, uint32_t late_us, uint32_t run_us,
+		bool dropped) {
+	unsigned late_b = late_us ? 32u - (unsigned) __builtin_clz(late_us) : 0u;
+	unsigned run_b = run_us ? 32u - (unsigned) __builtin_clz(run_us) : 0u;
+
+	stats->lateness[late_b < TIMER_HIST_BUCKETS ? late_b : TIMER_HIST_BUCKETS - 1]++;
+	stats->runtime[run_b < TIMER_HIST_BUCKETS ? run_b : TIMER_HIST_BUCKETS - 1]++;
+	stats->fired++;
+	if (dropped) {
+		stats->dropped++;
+	}
+	if (late_us > stats->max_lateness_us) {
+		stats->max_lateness_us = late_us;
+	}
+	if (run_us > stats->max_runtime_us) {
+		stats->max_runtime_us = run_us;
+	}
+}
 
-	while (!m->stop) {
-		// schedule next absolute deadline
-		add_ms(&next, period);
+/**
+ * @brief Links an entry into the slot matching its expiry.
+ *
+ * The level is the smallest one whose range covers the distance from the
+ * wheel position, so the slot's start always lies ahead of `w->now`.
+ * Entries beyond the top level's range (possible when `w->now` lags the
+ * clock) are parked in its furthest slot and relinked when it cascades.
+ * Caller holds `w->lock` and guarantees `e->expires > w->now`.
+ */
+void wheel_link(timer_wheel_t *w, timer_callback_entry_t *e) {
+	uint64_t expires = e->expires;
+	uint8_t level = 0;
 
-		// release lock while sleeping and executing callbacks
-		pthread_mutex_unlock(&m->lock);
+	if (expires - w->now > TIMER_MAX_PERIOD_MS) {
+		expires = w->now + TIMER_MAX_PERIOD_MS;
+	}
+	while (level < TIMER_WHEEL_LEVELS - 1
+			&& expires - w->now >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+		level++;
+	}
+	uint8_t slot = (uint8_t) ((expires >> (TIMER_WHEEL_BITS * level))
+			& WHEEL_MASK);
+
+	e->level = level;
+	e->slot = slot;
+	e->wheel_prev = NULL;
+	e->wheel_next = w->slots[level][slot];
+	if (e->wheel_next) {
+		e->wheel_next->wheel_prev = e;
+	}
+	w->slots[level][slot] = e;
+	w->occupied[level] |= 1ULL << slot;
+}
+
+/**
+ * @brief Removes an entry from its wheel slot, if linked.
+ */
+void wheel_unlink(timer_wheel_t *w, timer_callback_entry_t *e) {
+	if (e->level == WHEEL_UNLINKED) {
+		return;
+	}
+	if (e->wheel_prev) {
+		e->wheel_prev->wheel_next = e->wheel_next;
+	} else {
+		w->slots[e->level][e->slot] = e->wheel_next;
+		if (!e->wheel_next) {
+			w->occupied[e->level] &= ~(1ULL << e->slot);
+		}
+	}
+	if (e->wheel_next) {
+		e->wheel_next->wheel_prev = e->wheel_prev;
+	}
+	e->wheel_prev = e->wheel_next = NULL;
+	e->level = WHEEL_UNLINKED;
+}
+
+/**
+ * @brief Tick at which the wheel next has work to do.
+ *
+ * For each level, the first occupied slot after the current position is
+ * found by rotating the occupancy bitmap; its start is either an expiry
+ * (level 0) or a cascade point (higher levels).
+ *
+ * @return The earliest such tick, or WHEEL_IDLE if the wheel is empty.
+ */
+uint64_t wheel_next_expiry(const timer_wheel_t *w) {
+	uint64_t best = WHEEL_IDLE;
+
+	for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+		uint64_t bits = w->occupied[level];
+		if (!bits) {
+			continue;
+		}
+		unsigned shift = TIMER_WHEEL_BITS * level;
+		uint64_t block = w->now >> shift;
+		unsigned rot = (unsigned) ((block + 1) & WHEEL_MASK);
+		uint64_t ahead = rot ? (bits >> rot) | (bits << (WHEEL_SIZE - rot)) : bits;
+		uint64_t tick = (block + 1 + (uint64_t) __builtin_ctzll(ahead)) << shift;
+		if (tick < best) {
+			best = tick;
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief Latest tick the timer thread may sleep until.
+ *
+ * The minimum of expiry plus slack over all linked entries. Occupied slots
+ * are visited in time order per level, stopping once a slot starts after
+ * the best deadline found, so only the first few entries are looked at.
+ *
+ * @return The deadline, or WHEEL_IDLE if the wheel is empty.
+ */
+uint64_t wheel_next_deadline(const timer_wheel_t *w) {
+	uint64_t best = WHEEL_IDLE;
+
+	for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+		uint64_t bits = w->occupied[level];
+		unsigned shift = TIMER_WHEEL_BITS * level;
+		uint64_t block = (w->now >> shift) + 1;
+		unsigned rot = (unsigned) (block & WHEEL_MASK);
+		uint64_t ahead = rot ? (bits >> rot) | (bits << (WHEEL_SIZE - rot)) : bits;
+
+		while (ahead) {
+			uint64_t first = block + (uint64_t) __builtin_ctzll(ahead);
+			if ((first << shift) >= best) {
+				break;
+			}
+			for (const timer_callback_entry_t *e =
+					w->slots[level][first & WHEEL_MASK]; e; e = e->wheel_next) {
+				if (e->expires + e->slack_ms < best) {
+					best = e->expires + e->slack_ms;
+				}
+			}
+			ahead &= ahead - 1;
+		}
+	}
+	return best;
+}
 
-		// absolute sleep (handles EINTR)
-		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)
-				== EINTR) {
+/**
+ * @brief Arms the timerfd for @p tick, or disarms it for WHEEL_IDLE.
+ */
+void wheel_program(timer_wheel_t *w, uint64_t tick) {
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+
+	if (tick != WHEEL_IDLE) {
+		uint64_t ms = tick * TIMER_TICK_MS;
+		its.it_value.tv_sec = w->epoch.tv_sec + (time_t) (ms / 1000);
+		its.it_value.tv_nsec = w->epoch.tv_nsec + (long) (ms % 1000) * 1000000L;
+		if (its.it_value.tv_nsec >= 1000000000L) {
+			its.it_value.tv_sec++;
+			its.it_value.tv_nsec -= 1000000000L;
 		}
+	}
+	w->deadline = tick;
+	timerfd_settime(w->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * @brief Adds an expired entry to the batch, highest priority first.
+ */
+void wheel_queue_due(timer_callback_entry_t **due, timer_callback_entry_t *e) {
+	while (*due && (*due)->priority >= e->priority) {
+		due = &(*due)->due_next;
+	}
+	e->due_next = *due;
+	*due = e;
+	e->firing = true;
+	e->due_tick = e->expires;
+}
 
-		// dispatch callbacks
-		pthread_mutex_lock(&m->lock);
-		if (m->armed_count > 0) {
-			for (timer_callback_entry_t *e = m->callbackList; e;) {
-				if (e->state == ARM && e->callback) {
-					timer_callback_entry_t *next_e = e->next; // save before unlock
-					pthread_mutex_unlock(&m->lock);
-					e->callback(e->context);
-					if (e->one_shot)
-						e->state = DISARM;
-					pthread_mutex_lock(&m->lock);
-					e = next_e;                                // move on safely
+/**
+ * @brief Advances the wheel to tick @p to and collects expired entries.
+ *
+ * Jumps from one occupied slot start to the next rather than stepping
+ * every tick. At each stop, higher-level slots starting there are
+ * cascaded into lower levels before the level-0 slot is expired.
+ * Periodic entries are relinked for their next period before returning.
+ * Caller holds `w->lock`.
+ *
+ * @return The expired entries, ordered by priority.
+ */
+timer_callback_entry_t* wheel_advance(timer_wheel_t *w, uint64_t to) {
+	timer_callback_entry_t *due = NULL;
+
+	for (uint64_t tick; (tick = wheel_next_expiry(w)) <= to;) {
+		w->now = tick;
+
+		for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+			unsigned shift = TIMER_WHEEL_BITS * (unsigned) level;
+			if (tick & ((1ULL << shift) - 1)) {
+				continue;
+			}
+			uint8_t slot = (uint8_t) ((tick >> shift) & WHEEL_MASK);
+			timer_callback_entry_t *e = w->slots[level][slot];
+			w->slots[level][slot] = NULL;
+			w->occupied[level] &= ~(1ULL << slot);
+			while (e) {
+				timer_callback_entry_t *next = e->wheel_next;
+				e->level = WHEEL_UNLINKED;
+				e->wheel_prev = e->wheel_next = NULL;
+				if (e->expires <= tick) {
+					wheel_queue_due(&due, e);
 				} else {
-					e = e->next;
+					wheel_link(w, e);
 				}
+				e = next;
 			}
 		}
 
-		// If we overran, skip ahead to the next boundary (no drift)
-		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC, &now);
-		while ((now.tv_sec > next.tv_sec)
-				|| (now.tv_sec == next.tv_sec && now.tv_nsec >= next.tv_nsec)) {
-			add_ms(&next, period);
+		uint8_t slot = (uint8_t) (tick & WHEEL_MASK);
+		timer_callback_entry_t *e = w->slots[0][slot];
+		w->slots[0][slot] = NULL;
+		w->occupied[0] &= ~(1ULL << slot);
+		while (e) {
+			timer_callback_entry_t *next = e->wheel_next;
+			e->level = WHEEL_UNLINKED;
+			e->wheel_prev = e->wheel_next = NULL;
+			wheel_queue_due(&due, e);
+			e = next;
 		}
+	}
+	w->now = to;
 
-		// If no work now, park until someone arms again
-		while (!m->stop && m->armed_count == 0)
-			pthread_cond_wait(&m->cv, &m->lock);
+	// Reschedule periodic entries; skip whole periods missed by an overrun
+	for (timer_callback_entry_t *e = due; e; e = e->due_next) {
+		if (e->one_shot) {
+			e->state = DISARM;
+			continue;
+		}
+		e->expires += e->period_ms;
+		if (e->expires <= to) {
+			uint64_t missed = (to - e->expires) / e->period_ms + 1;
+			e->expires += missed * e->period_ms;
+			e->stats.skipped += (uint32_t) missed;
+			w->total.skipped += (uint32_t) missed;
+		}
+		wheel_link(w, e);
 	}
+	return due;
+}
+
+void* timer_thread(void *arg) {
+	timer_wheel_t *w = (timer_wheel_t*) arg;
+	uint64_t expirations;
+
+	for (;;) {
+		// Sleeps until the next expiry; never wakes while nothing is armed
+		if (read(w->tfd, &expirations, sizeof(expirations)) < 0
+				&& errno != EINTR && errno != EAGAIN) {
+			break;
+		}
 
-	pthread_mutex_unlock(&m->lock);
+		pthread_mutex_lock(&w->lock);
+		if (w->stop) {
+			pthread_mutex_unlock(&w->lock);
+			break;
+		}
+		timer_callback_entry_t *due = wheel_advance(w, wheel_ticks(w));
+		wheel_program(w, wheel_next_deadline(w));
+
+		// post time events, then run callbacks with the lock released
+		while (due) {
+			timer_callback_entry_t *e = due;
+			due = e->due_next;
+			if (!e->removed && (e->owner || e->callback)) {
+				uint64_t start = wheel_us(w);
+				bool queued = true;
+				if (e->owner) {
+					message_frame_t event = { .signal = e->signal };
+					queued = try_post(e->owner, &event, e->urgent);
+				} else {
+					timer_callback_t callback = e->callback;
+					void *context = e->context;
+					pthread_mutex_unlock(&w->lock);
+					callback(context);
+					pthread_mutex_lock(&w->lock);
+				}
+				uint64_t end = wheel_us(w);
+				uint64_t nominal = e->due_tick * 1000ULL * TIMER_TICK_MS;
+				uint64_t late = start > nominal ? start - nominal : 0;
+				uint32_t late_us = late > UINT32_MAX ? UINT32_MAX : (uint32_t) late;
+				uint32_t run_us = end - start > UINT32_MAX ?
+						UINT32_MAX : (uint32_t) (end - start);
+				stats_record(&e->stats, late_us, run_us, !queued);
+				stats_record(&w->total, late_us, run_us, !queued);
+			}
+			e->firing = false;
+			if (e->removed || e->transient) {
+				pool_release(w, e);
+			}
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
 	return NULL;
 }
 
-// Add a callback to a timer with priority
+// Add a callback to a legacy fixed-period timer
 timer_callback_entry_t* timer_manager_add_callback(uint8_t timer_id,
 		timer_callback_t callback, void *context, uint8_t priority,
 		bool one_shot) {
 	if (timer_id >= MAX_TIMERS) {
 		return NULL; // Invalid timerId
 	}
-	timer_manager_t *m = &timer_manager[timer_id];
-	pthread_mutex_lock(&m->lock);
-	timer_callback_entry_t *newEntry = (timer_callback_entry_t*) malloc(
-			sizeof(timer_callback_entry_t));
-	if (!newEntry) {
-		return NULL; // Memory allocation failed
-	}
-	pthread_mutex_init(&newEntry->sem_entry, NULL);
-
-	newEntry->timer_id = timer_id;
-	newEntry->state = DISARM;
-	newEntry->one_shot = one_shot;
-	newEntry->callback = callback;
-	newEntry->context = context;
-	newEntry->priority = priority;
-	newEntry->next = NULL;
-
-	// Insert the new callback in sorted order based on priority
-	timer_callback_entry_t **head = &timer_manager[timer_id].callbackList;
-	if (*head == NULL || (*head)->priority < priority) {
-		// Insert at the head if higher priority
-		newEntry->next = *head;
-		*head = newEntry;
-	} else {
-		// Insert in sorted order
-		timer_callback_entry_t *current = *head;
-		while (current->next != NULL && current->next->priority >= priority) {
-			current = current->next;
+	timer_callback_entry_t *entry = timer_manager_add_callback_ms(
+			timer_period_ms(timer_id), callback, context, priority, one_shot);
+	if (entry) {
+		entry->timer_id = timer_id;
+	}
+	return entry;
+}
+
+// Take an entry from the pool and fill it in
+timer_callback_entry_t* timer_entry_new(uint32_t period_ms,
+		timer_callback_t callback, void *context, uint8_t priority,
+		base_obj_t *owner, uint32_t signal, bool urgent, bool one_shot) {
+	if (period_ms == 0 || period_ms > TIMER_MAX_PERIOD_MS) {
+		return NULL; // Out of the wheel's range
+	}
+	timer_callback_entry_t *e = pool_acquire(&wheel);
+	if (!e) {
+		return NULL; // Pool exhausted
+	}
+	e->timer_id = TIMER_CUSTOM;
+	e->one_shot = one_shot;
+	e->callback = callback;
+	e->context = context;
+	e->priority = priority;
+	e->owner = owner;
+	e->signal = signal;
+	e->urgent = urgent;
+	e->period_ms = (period_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	e->slack_ms = TIMER_DEFAULT_SLACK_MS(e->period_ms);
+	return e;
+}
+
+// Add a callback with an arbitrary period
+timer_callback_entry_t* timer_manager_add_callback_ms(uint32_t period_ms,
+		timer_callback_t callback, void *context, uint8_t priority,
+		bool one_shot) {
+	pthread_mutex_lock(&wheel.lock);
+	timer_callback_entry_t *e = timer_entry_new(period_ms, callback, context,
+			priority, NULL, 0, false, one_shot);
+	pthread_mutex_unlock(&wheel.lock);
+	return e;
+}
+
+// Add a time event posted to an Active Object
+timer_callback_entry_t* timer_manager_add_event(uint32_t period_ms,
+		base_obj_t *owner, uint32_t signal, bool urgent, bool one_shot) {
+	if (!owner) {
+		return NULL;
+	}
+	pthread_mutex_lock(&wheel.lock);
+	timer_callback_entry_t *e = timer_entry_new(period_ms, NULL, NULL, 0,
+			owner, signal, urgent, one_shot);
+	pthread_mutex_unlock(&wheel.lock);
+	return e;
+}
+
+// Start a pooled one-shot callback
+timer_handle_t timer_manager_oneshot(uint32_t delay_ms,
+		timer_callback_t callback, void *context, uint8_t priority) {
+	timer_handle_t handle = TIMER_HANDLE_INVALID;
+	pthread_mutex_lock(&wheel.lock);
+	timer_callback_entry_t *e = timer_entry_new(delay_ms, callback, context,
+			priority, NULL, 0, false, true);
+	if (e) {
+		e->transient = true;
+		handle = pool_handle(&wheel, e);
+		wheel_arm(&wheel, e);
+	}
+	pthread_mutex_unlock(&wheel.lock);
+	return handle;
+}
+
+// Start a pooled one-shot time event
+timer_handle_t timer_manager_oneshot_event(uint32_t delay_ms,
+		base_obj_t *owner, uint32_t signal, bool urgent) {
+	timer_handle_t handle = TIMER_HANDLE_INVALID;
+	if (!owner) {
+		return handle;
+	}
+	pthread_mutex_lock(&wheel.lock);
+	timer_callback_entry_t *e = timer_entry_new(delay_ms, NULL, NULL, 0,
+			owner, signal, urgent, true);
+	if (e) {
+		e->transient = true;
+		handle = pool_handle(&wheel, e);
+		wheel_arm(&wheel, e);
+	}
+	pthread_mutex_unlock(&wheel.lock);
+	return handle;
+}
+
+// Cancel a timer by handle
+bool timer_manager_cancel(timer_handle_t handle) {
+	timer_wheel_t *w = &wheel;
+	uint32_t index = (handle & 0xFFFFu) - 1u;
+	bool cancelled = false;
+
+	if (index >= TIMER_POOL_SIZE) {
+		return false;
+	}
+	pthread_mutex_lock(&w->lock);
+	timer_callback_entry_t *e = &w->pool[index];
+	if (e->in_use && !e->removed && e->generation == (uint16_t) (handle >> 16)) {
+		wheel_unlink(w, e);
+		pool_release(w, e);
+		cancelled = true;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return cancelled;
+}
+
+// Copy the statistics of every live timer
+uint16_t timer_manager_stats(timer_stats_entry_t *out, uint16_t max,
+		timer_stats_t *total) {
+	timer_wheel_t *w = &wheel;
+	uint16_t n = 0;
+
+	pthread_mutex_lock(&w->lock);
+	for (uint32_t i = 0; i < TIMER_POOL_SIZE && n < max; ++i) {
+		const timer_callback_entry_t *e = &w->pool[i];
+		if (!e->in_use || e->removed) {
+			continue;
 		}
-		newEntry->next = current->next;
-		current->next = newEntry;
+		out[n].timer_id = e->timer_id;
+		out[n].one_shot = e->one_shot;
+		out[n].period_ms = e->period_ms * TIMER_TICK_MS;
+		out[n].slack_ms = e->slack_ms * TIMER_TICK_MS;
+		out[n].callback = e->callback;
+		out[n].owner = e->owner ? e->owner->name : NULL;
+		out[n].signal = e->signal;
+		out[n].stats = e->stats;
+		n++;
+	}
+	if (total) {
+		*total = w->total;
 	}
-	pthread_mutex_unlock(&m->lock);
-	return newEntry; // Success
+	pthread_mutex_unlock(&w->lock);
+	return n;
 }
 
 // Remove a callback from a timer
 void timer_manager_remove_callback(uint8_t timer_id, timer_callback_t callback) {
-	if (timer_id >= MAX_TIMERS)
-		return;
-	timer_manager_t *m = &timer_manager[timer_id];
-	pthread_mutex_lock(&m->lock);
-	timer_callback_entry_t **head = &m->callbackList;
-	timer_callback_entry_t *current = *head, *prev = NULL;
-
-	while (current != NULL) {
-		if (current->callback == callback && current->timer_id == timer_id) {
-			if (prev == NULL) {
-				*head = current->next; // Remove first element
-			} else {
-				prev->next = current->next;
-			}
-			free(current);
-			return;
+	timer_wheel_t *w = &wheel;
+	pthread_mutex_lock(&w->lock);
+	for (uint32_t i = 0; i < TIMER_POOL_SIZE; ++i) {
+		timer_callback_entry_t *e = &w->pool[i];
+		if (e->in_use && !e->transient && !e->removed
+				&& e->callback == callback && e->timer_id == timer_id) {
+			wheel_unlink(w, e);
+			pool_release(w, e);
+			break;
 		}
-		prev = current;
-		current = current->next;
 	}
-	pthread_mutex_unlock(&m->lock);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * @brief Links a disarmed entry one period from now and reprograms the
+ *        timerfd if its deadline is earlier. Caller holds `w->lock`.
+ */
+void wheel_arm(timer_wheel_t *w, timer_callback_entry_t *e) {
+	e->state = ARM;
+	uint64_t now = wheel_ticks(w);
+	e->expires = (now > w->now ? now : w->now) + e->period_ms;
+	wheel_link(w, e);
+	if (e->expires + e->slack_ms < w->deadline) {
+		wheel_program(w, e->expires + e->slack_ms);
+	}
 }
 
 void arm(timer_callback_entry_t *e) {
-	timer_manager_t *m = &timer_manager[e->timer_id];
-	pthread_mutex_lock(&m->lock);
-	if (e->state != ARM) {
-		e->state = ARM;
-		m->armed_count++;
-		pthread_cond_signal(&m->cv); // wake thread if parked
-	}
-	pthread_mutex_unlock(&m->lock);
+	timer_wheel_t *w = &wheel;
+	pthread_mutex_lock(&w->lock);
+	if (e->in_use && !e->removed && e->state != ARM) {
+		wheel_arm(w, e);
+	}
+	pthread_mutex_unlock(&w->lock);
 }
 
 void disarm(timer_callback_entry_t *e) {
-	timer_manager_t *m = &timer_manager[e->timer_id];
-	pthread_mutex_lock(&m->lock);
+	timer_wheel_t *w = &wheel;
+	pthread_mutex_lock(&w->lock);
 	if (e->state == ARM) {
 		e->state = DISARM;
-		if (m->armed_count > 0)
-			m->armed_count--;
-		// If it drops to 0, the thread will park on next loop
+		wheel_unlink(w, e);
+		// A stale timerfd deadline only costs one spurious wake-up
+	}
+	pthread_mutex_unlock(&w->lock);
+}
+
+void set_slack(timer_callback_entry_t *e, uint32_t slack_ms) {
+	timer_wheel_t *w = &wheel;
+	pthread_mutex_lock(&w->lock);
+	if (e->in_use) {
+		e->slack_ms = (slack_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+		if (e->state == ARM && e->expires + e->slack_ms < w->deadline) {
+			wheel_program(w, e->expires + e->slack_ms);
+		}
 	}
-	pthread_mutex_unlock(&m->lock);
+	pthread_mutex_unlock(&w->lock);
 }
 
 #ifdef __cplusplus
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <pthread.h>
+#include <time.h>
 #include "active_object.h"
 #include "fsm.h"
 #include "broker.h"
@@ -17,40 +18,304 @@ extern "C" {
 #define WS_MAX_CLIENTS  64
 #endif
 #ifndef WS_RX_BUFSZ
-#define WS_RX_BUFSZ     4096
+#define WS_RX_BUFSZ     8192        /* a whole request, headers and body */
+#endif
+#ifndef WS_MSG_MAX
+#define WS_MSG_MAX      4096        /* reassembled client message, < WS_RX_BUFSZ */
 #endif
 #ifndef WS_TX_BUFSZ
 #define WS_TX_BUFSZ     1024
 #endif
 #ifndef WS_OUTQ_LEN
-#define WS_OUTQ_LEN     16
+#define WS_OUTQ_LEN     8           /* initial WS send ring, grown on demand */
+#endif
+#ifndef WS_OUT_BUDGET
+#define WS_OUT_BUDGET   (64u * 1024) /* queued bytes per WS client */
+#endif
+#ifndef WS_OUT_STALL_MS
+#define WS_OUT_STALL_MS 10000       /* backlogged this long: client evicted */
+#endif
+#ifndef WS_CMD_LEN
+#define WS_CMD_LEN      64          /* AO -> reactor ring, a power of two */
+#endif
+#ifndef WS_POOL_KEEP
+#define WS_POOL_KEEP    4           /* idle buffers kept per pool class */
+#endif
+#ifndef WS_DEFLATE_MIN
+#define WS_DEFLATE_MIN  64          /* shorter messages are sent uncompressed */
+#endif
+#ifndef WS_DEFLATE_WBITS
+#define WS_DEFLATE_WBITS 11         /* permessage-deflate window, 2^n bytes */
+#endif
+/* WebSocket subprotocol carrying broker frames as binary messages: signal
+ * and length as big-endian uint32, then the payload bytes. Clients that do
+ * not offer it get JSON text. */
+#define WS_SUBPROTOCOL  "rtef.frame"
+#define WS_BIN_HDR      8
+
+#ifndef WS_REACTORS_MAX
+#define WS_REACTORS_MAX 4           /* pump threads, see ws_set_reactors() */
 #endif
 #ifndef WS_DOCROOT_MAX
 #define WS_DOCROOT_MAX  256
 #endif
+#ifndef WS_ASSET_MAX
+#define WS_ASSET_MAX    64          /* cached docroot files */
+#endif
+#ifndef WS_ASSET_MAX_SIZE
+#define WS_ASSET_MAX_SIZE (1u << 20) /* larger files are served uncached */
+#endif
+
+#ifndef WS_HTTP_HDR_MAX
+#define WS_HTTP_HDR_MAX 512         /* response header, built per request */
+#endif
+#ifndef WS_HTTP_MAX_HEADERS
+#define WS_HTTP_MAX_HEADERS 32
+#endif
+#ifndef WS_HTTP_IDLE_MS
+#define WS_HTTP_IDLE_MS 5000        /* keep-alive idle timeout */
+#endif
+#ifndef WS_HTTP_MAX_REQS
+#define WS_HTTP_MAX_REQS 100        /* requests per connection before close */
+#endif
+
+#ifndef WS_LIVE_SLOTS
+#define WS_LIVE_SLOTS   8           /* records per array document (max 16) */
+#endif
+#ifndef WS_LIVE_REC_MAX
+#define WS_LIVE_REC_MAX 384         /* JSON bytes per record */
+#endif
+#ifndef WS_LIVE_LOG_LEN
+#define WS_LIVE_LOG_LEN 64          /* log records kept for loghead/lognext */
+#endif
+#ifndef WS_LIVE_LOG_READERS
+#define WS_LIVE_LOG_READERS 16      /* peers walking the log at the same time */
+#endif
+
+/* Live JSON documents served from memory (see ws_routes in ao_ws.c) and fed
+ * through WS_LIVE_UPDATE(doc, slot). */
+typedef enum {
+	WS_DOC_MODULE_CONTROL = 0, /* /module_control.json, array by slot */
+	WS_DOC_MODULE_MONITORING, /* /module_monitoring.json, array by slot */
+	WS_DOC_MODULE_INFO, /* /module_info.json, array by slot */
+	WS_DOC_SIDEBAR, /* /sidebar.json, array by slot */
+	WS_DOC_SUMMARY, /* /summary.json, array by slot */
+	WS_DOC_SETTINGS, /* /settings.json, one object (slot 0) */
+	WS_DOC_LOG, /* /loghead.json, /lognext.json, appended records */
+	WS_DOC_COUNT
+} ws_doc_t;
+
+/* Snapshot of one array/object document */
+typedef struct {
+	uint32_t version; /* 0 until first published */
+	time_t mtime;
+	uint8_t nrec;
+	uint16_t len[WS_LIVE_SLOTS];
+	char rec[WS_LIVE_SLOTS][WS_LIVE_REC_MAX];
+} ws_live_doc_t;
+
+/* Position of one peer walking the log with loghead/lognext */
+typedef struct {
+	uint8_t addr[16]; /* IPv6, or IPv4-mapped */
+	uint32_t next; /* sequence number of its next record */
+	uint32_t used; /* log request count at its last request, 0: free */
+} ws_log_reader_t;
+
+/* Log records, oldest first */
+typedef struct {
+	uint16_t head, count; /* oldest record, records held */
+	uint32_t seq; /* sequence number of the oldest record */
+	uint32_t requests; /* loghead/lognext requests served */
+	ws_log_reader_t reader[WS_LIVE_LOG_READERS];
+	uint16_t len[WS_LIVE_LOG_LEN];
+	char rec[WS_LIVE_LOG_LEN][WS_LIVE_REC_MAX];
+} ws_live_log_t;
+
+struct ws_asset; /* cached static file, see ao_ws.c */
+struct z_stream_s; /* zlib */
 
 typedef enum {
 	WS_CL_FREE = 0, WS_CL_HTTP, WS_CL_WS
 } ws_cl_state_t;
 
+/* Byte range inside a client's rx buffer */
+typedef struct {
+	uint32_t off, len;
+} ws_slice_t;
+
+/* Resumable HTTP/1.1 request parser state. Every field is an offset into the
+ * client's rx buffer, so a request split over any number of reads is parsed
+ * once, in place. */
+typedef struct {
+	uint8_t state;
+	uint8_t minor; /* HTTP/1.<minor> */
+	uint8_t chunked;
+	uint8_t nhdr;
+	uint32_t line; /* start of the line (or chunk) being parsed */
+	uint32_t scan; /* searched for LF up to here */
+	uint32_t body; /* body start; chunked bodies are compacted here */
+	uint32_t body_len;
+	uint32_t need; /* body or current chunk bytes still expected */
+	ws_slice_t method, target;
+	ws_slice_t name[WS_HTTP_MAX_HEADERS], value[WS_HTTP_MAX_HEADERS];
+} ws_http_req_t;
+
+/* Resumable WebSocket frame decoder. Bytes are fed as they arrive; data
+ * frames are unmasked into the message buffer (a WS_POOL_RX buffer held while
+ * a message is in progress) until its final fragment, control frames into
+ * ctl, which they may interleave with fragments. */
+typedef struct {
+	uint8_t state; /* WS_RD_* in ao_ws.c */
+	uint8_t hdr[14]; /* header up to the mask */
+	uint8_t hlen, hneed;
+	uint8_t opcode, fin;
+	uint64_t left; /* payload bytes of the frame still to come */
+	uint32_t pos; /* payload bytes of the frame seen, for the mask */
+	uint8_t msg_op; /* 0x1 or 0x2 while a message is in progress, else 0 */
+	uint8_t msg_deflated; /* RSV1 on its first frame */
+	char *msg;
+	size_t msg_len;
+	uint8_t ctl[125];
+} ws_frame_rd_t;
+
+/* Buffer pool size classes (see ws_pool_size in ao_ws.c) */
+typedef enum {
+	WS_POOL_HDR = 0, /* WS_HTTP_HDR_MAX: response header */
+	WS_POOL_RX, /* WS_RX_BUFSZ: request buffer */
+	WS_POOL_CLASSES
+} ws_pool_class_t;
+
+/* Server->client message classes, each with its own WS_OUT_* policy for a
+ * client that is over WS_OUT_BUDGET (see ws_set_out_policy) */
+typedef enum {
+	WS_MSG_REPLY = 0, /* answers to one client: hello, trace, timers */
+	WS_MSG_QUERY, /* WS_QUERY_RX_CMD results, keyed by signal */
+	WS_MSG_LIVE, /* live document records, keyed by doc and slot */
+	WS_MSG_EVENT, /* broadcasts */
+	WS_MSG_CLASSES
+} ws_msg_class_t;
+
+typedef enum {
+	WS_OUT_DROP = 0, /* the new message is dropped */
+	WS_OUT_CONFLATE /* it replaces a queued, unsent one with the same key,
+	 whatever the budget; dropped when there is none */
+} ws_out_policy_t;
+
+/* Queued server->client frame: an encoded frame shared by every client it
+ * was queued for (ws_frame_t in ao_ws.c), the bytes already sent of it and
+ * its conflation key (0: none). */
+typedef struct {
+	struct ws_frame *f;
+	uint32_t off;
+	uint32_t key;
+} ws_out_t;
+
+/* Send queue metrics of one WS client, written by its reactor and read by the
+ * AO (relaxed atomics) */
+typedef struct {
+	uint32_t depth; /* frames queued */
+	uint32_t bytes; /* bytes queued */
+	uint32_t peak; /* highest bytes */
+	uint32_t dropped; /* messages dropped over budget */
+	uint32_t conflated; /* queued messages replaced by a newer one */
+	uint64_t stall_ms; /* backlogged since (monotonic), 0 when drained */
+} ws_out_stats_t;
+
 typedef struct {
 	int fd;
 	ws_cl_state_t st;
+	uint32_t gen; /* slot generation, part of the epoll tag */
 	unsigned long long conn_id;
 
-	/* HTTP request buffer */
-	char rx[WS_RX_BUFSZ];
+	/* HTTP request buffer (WS_RX_BUFSZ, pooled while bytes are buffered); may
+	 * hold several pipelined requests */
+	char *rx;
+	size_t rx_len;
+	ws_http_req_t req;
+
+	/* HTTP persistent connection */
+	uint8_t keep_alive; /* current response leaves the connection open */
+	uint8_t lingering; /* error sent; draining input until the peer closes */
+	uint8_t rd_eof; /* peer sent FIN: answer what was received, then close */
+	uint8_t upgrading; /* 101 queued in http_hdr; WS_CL_WS once it is sent */
+	uint16_t nreq; /* requests served on this connection */
+	uint64_t last_io_ms; /* monotonic, for the idle timeout */
 
-	/* HTTP non-blocking transmit (header+file bytes) */
-	char *http_tx; /* malloc'd buffer with full response */
-	size_t http_len; /* total bytes to send */
+	/* HTTP non-blocking transmit: header, then body bytes, then file. The
+	 * header buffer (WS_HTTP_HDR_MAX) is pooled while a response is built. */
+	char *http_hdr;
+	size_t hdr_len, hdr_off;
+	const char *http_tx; /* body: cached asset or static text, or NULL */
+	struct ws_asset *asset; /* cache entry pinned while http_tx points into it */
+	size_t http_len; /* body bytes to send */
 	size_t http_off; /* bytes sent already */
+	int file_fd; /* uncached body streamed by sendfile(), or -1 */
+	off_t file_off, file_end;
 
-	/* WS per-client TX ring (text frames) */
-	int out_head, out_tail;
-	char out_q[WS_OUTQ_LEN][WS_TX_BUFSZ];
+	/* WS per-client TX ring, written out in place by sendmsg(); grown while
+	 * the queued bytes stay within WS_OUT_BUDGET */
+	ws_out_t *out_q;
+	int out_cap, out_head, out_tail;
+	size_t out_bytes;
+	uint8_t out_armed; /* EPOLLOUT requested for the ring */
+	ws_out_stats_t out_st;
+
+	/* permessage-deflate (RFC 7692), negotiated at the upgrade. One context
+	 * per direction, created on first use and kept across messages unless
+	 * the peer asked for no_context_takeover. */
+	uint8_t pmd; /* WS_PMD_* flags in ao_ws.c, 0 when not negotiated */
+	uint8_t pmd_sbits, pmd_cbits; /* server (deflate) and client windows */
+	struct z_stream_s *zd, *zi; /* deflater, inflater */
+
+	uint8_t binary; /* WS_SUBPROTOCOL negotiated */
+	ws_frame_rd_t rd; /* WebSocket receive */
 } ws_client_t;
 
+struct ao_ws;
+
+/* One pump thread: its own epoll set, SO_REUSEPORT listener and command
+ * queue, serving the client slots [first, first + count). The kernel spreads
+ * new connections over the listeners, and a connection stays with the
+ * reactor that accepted it. */
+typedef struct ws_reactor {
+	struct ao_ws *ws;
+	int id;
+	int first, count; /* client partition */
+
+	int epfd;
+	int listenfd;
+	int notifyfd; /* eventfd for AO->reactor wake */
+	pthread_t tid;
+	uint8_t started; /* tid is running and must be joined */
+
+	/* Per-connection buffers: idle ones by size class, up to WS_POOL_KEEP
+	 * each, linked through their first bytes */
+	struct {
+		void *idle[WS_POOL_CLASSES];
+		int nidle[WS_POOL_CLASSES];
+	} pool;
+
+	/* permessage-deflate output, grown on demand */
+	unsigned char *zbuf;
+	size_t zcap;
+
+	/* AO -> reactor command ring: one producer (the AO thread), one consumer
+	 * (this reactor), no lock. Indices run free and are masked on use; each
+	 * side owns one and only reads the other. notifyfd is written once per
+	 * batch: while armed is set the reactor is already due to drain. */
+	struct {
+		uint32_t head __attribute__((aligned(64))); /* consumer */
+		uint32_t tail __attribute__((aligned(64))); /* producer */
+		uint32_t dropped; /* producer: lost to a full ring, atomic */
+		uint8_t armed;
+		struct {
+			int target_idx; /* -1: every WS client of this reactor, -2: those
+			                 * set in the frame's client mask */
+			struct ws_frame *f; /* encoded by the AO thread, owned by the ring */
+		} q[WS_CMD_LEN];
+	} cmd;
+} ws_reactor_t;
+
 typedef struct ao_ws {
 	base_obj_t super; /* MUST be first */
 
@@ -58,28 +323,42 @@ typedef struct ao_ws {
 	uint16_t port;
 	char docroot[WS_DOCROOT_MAX]; /* e.g., "./www" */
 
-	/* Reactor state */
-	int epfd;
-	int listenfd;
-	int notifyfd; /* eventfd for AO->pump wake */
-
-	/* Thread */
-	pthread_t pump_tid;
+	/* Pump threads */
+	ws_reactor_t reactor[WS_REACTORS_MAX];
+	int nreactors;
 	volatile int pump_running;
 
-	/* Clients */
-	ws_client_t clients[WS_MAX_CLIENTS];
-	unsigned long long id_seq;
-
-	/* Cross-thread command queue (AO -> pump) */
+	/* Static asset cache shared by the reactors under mx, invalidated through
+	 * inotify (watched by reactor 0) */
 	struct {
-		int head, tail;
+		pthread_mutex_t mx;
+		struct ws_asset *tab[WS_ASSET_MAX];
+		int count;
+		uint32_t gen; /* bumped by every batch of invalidations */
+		int ifd; /* inotify fd, -1 disables caching */
 		struct {
-			int target_idx;
-			char msg[WS_TX_BUFSZ];
-		} q[64];
+			int wd;
+			char dir[WS_DOCROOT_MAX + 512];
+		} dirs[WS_ASSET_MAX];
+		int ndirs;
+	} cache;
+
+	/* Live JSON documents: records written by the AO thread under mx, bodies
+	 * rendered on demand by the pump and kept until the version moves. */
+	struct {
 		pthread_mutex_t mx;
-	} cmd;
+		ws_live_doc_t doc[WS_DOC_COUNT];
+		ws_live_log_t log;
+		struct ws_asset *body[WS_DOC_COUNT]; /* reactors only */
+		uint32_t rendered[WS_DOC_COUNT]; /* version of body[] */
+		uint16_t sub[WS_MAX_CLIENTS][WS_DOC_COUNT]; /* AO only: slot mask per WS client */
+	} live;
+
+	/* Clients, partitioned between the reactors */
+	ws_client_t clients[WS_MAX_CLIENTS];
+	unsigned long long id_seq; /* shared by the reactors, atomic */
+	uint8_t out_policy[WS_MSG_CLASSES]; /* ws_out_policy_t by ws_msg_class_t */
+	uint32_t evicted; /* slow clients dropped, atomic */
 } ao_ws_t;
 
 /* FSM states */
@@ -90,9 +369,20 @@ extern state_t ws_error_state;
 /* Constructor */
 void ws_ctor(ao_ws_t *me, broker_t *broker, char *name, uint16_t port);
 
-/* Optional: set/override document root (default: "./www") */
+/* Optional: set/override document root (default: "/var/www/html").
+ * Call before start(). */
 void ws_set_docroot(ao_ws_t *me, const char *path);
 
+/* Optional: serve with @p n reactor threads (default 1, up to
+ * WS_REACTORS_MAX), each accepting on its own SO_REUSEPORT listener.
+ * Call before start(). */
+void ws_set_reactors(ao_ws_t *me, int n);
+
+/* Optional: what to do with a message of class @p cls for a client whose
+ * send queue is over WS_OUT_BUDGET (default: WS_OUT_CONFLATE for
+ * WS_MSG_LIVE, WS_OUT_DROP otherwise). Call before start(). */
+void ws_set_out_policy(ao_ws_t *me, ws_msg_class_t cls, ws_out_policy_t policy);
+
 /* AO API */
 void ws_send_to(ao_ws_t *me, int client_idx, const char *text);
 void ws_broadcast(ao_ws_t *me, const char *text);
@@ -5,7 +5,7 @@
  * This file defines the CAN active object, which integrates with the event-driven
  * architecture. It manages message transmission, reception, filtering, and timeouts.
  * The system tracks pending messages and ensures reliable communication via a
- * circular buffer for timeout management.
+ * fixed table of pending requests, each with a pooled one-shot timeout.
  *
  * @author Nathan Ikolo
  * @date February 12, 2025
@@ -22,7 +22,13 @@ extern "C" {
 #include "ao_can.h"
 #include <sys_timer.h>
 
-#define MAX_PENDING_FRAMES 128 /**< Maximum number of pending CAN frames tracked */
+/**
+ * @brief Maximum number of pending CAN frames tracked.
+ *
+ * Every pending frame holds one entry of the shared timer pool, so the table
+ * is kept to half of it and leaves the rest to the other AOs.
+ */
+#define MAX_PENDING_FRAMES (TIMER_POOL_SIZE / 2)
 
 /**
  * @struct can_timeout_entry_t
@@ -30,22 +36,23 @@ extern "C" {
  */
 typedef struct {
 	message_frame_t frame; /**< The CAN frame */
-	timer_callback_entry_t *timerEntry; /**< Timer entry associated with the frame */
+	timer_handle_t timeout; /**< Pending timeout for the frame */
+	uint32_t seq; /**< Send order, to find the oldest entry */
+	volatile uint8_t in_use; /**< Entry holds a pending frame */
 } can_timeout_entry_t;
 
-// Circular buffer for pending CAN frames
+// Pending CAN frames; entries never move, a slot is freed in place
 static can_timeout_entry_t pendingFrames[MAX_PENDING_FRAMES];
-static volatile uint8_t head = 0; /**< Circular buffer head */
-static volatile uint8_t tail = 0; /**< Circular buffer tail */
-static volatile uint8_t count = 0; /**< Number of elements in the buffer */
+static uint32_t sendSeq = 0; /**< Sequence number of the last frame sent */
 
 static broker_t *broker_ptr = NULL;
 static can_obj_t *can_ptr = NULL;
 
 // Internal function prototypes
-static void ao_can_timeout(void *context);
+static void ao_can_timeout(can_obj_t *me, uint32_t correlationId);
 static void ao_can_send_with_timeout(can_obj_t *me, const message_frame_t *frame);
 static void ao_can_clear_timeout(can_obj_t *me, message_frame_t frame);
+static void ao_can_publish_timeout(message_frame_t frame);
 
 /**
  * @brief Dispatch function for processing received CAN frames.
@@ -56,6 +63,10 @@ static void ao_can_clear_timeout(can_obj_t *me, message_frame_t frame);
 static void dispatch(base_obj_t *const me, const message_frame_t *frame) {
 	message_frame_t frame1 = { 0 };
 	memcpy(&frame1, frame, sizeof(frame1));
+	if (CAN_IS_TIMEOUT(frame->signal)) {
+		ao_can_timeout((can_obj_t*) me, CAN_GET_CORRELATION_ID(frame->signal));
+		return;
+	}
 	switch (frame->topicOrServiceId) {
 		case INTERNAL_SYSTEM_TIME:
 #ifdef _WIN32
@@ -159,7 +170,10 @@ void CanIf_RxIndication(const Can_HwType *Mailbox, const PduInfoType *PduInfoPtr
 /**
  * @brief Sends a CAN frame with an associated timeout.
  *
- * Adds the frame to a circular buffer and starts a timeout timer.
+ * Records the frame in a free slot of the pending table (the oldest one is
+ * evicted when all are taken) and starts a timeout timer. If the timer pool
+ * is exhausted the request is not sent and a timeout is reported at once,
+ * since nothing would report a missing response.
  *
  * @param me Pointer to the CAN object.
  * @param frame Pointer to the message frame to be sent.
@@ -168,88 +182,96 @@ void ao_can_send_with_timeout(can_obj_t *me, const message_frame_t *frame) {
 	if (!me || !me->timerManager)
 		return;
 
-	if (count >= MAX_PENDING_FRAMES) {
-		head = (head + 1) % MAX_PENDING_FRAMES; // Overwrite oldest
-		count--;
+	uint8_t index = 0;
+	uint8_t oldest = 0;
+	while (index < MAX_PENDING_FRAMES && pendingFrames[index].in_use) {
+		if ((int32_t) (pendingFrames[index].seq - pendingFrames[oldest].seq) < 0)
+			oldest = index;
+		index++;
+	}
+	if (index == MAX_PENDING_FRAMES) {
+		index = oldest; // Overwrite oldest
+		pendingFrames[index].in_use = 0;
+		me->timerManager->cancel(pendingFrames[index].timeout);
 	}
 
-	uint8_t index = tail;
-	memcpy(&pendingFrames[index].frame, frame, sizeof(message_frame_t));
-
-	// Add timeout callback
-	pendingFrames[index].timerEntry = me->timerManager->add_callback(TIMER_100ms, ao_can_timeout, &pendingFrames[index], 1);
-
-	if (pendingFrames[index].timerEntry) {
-		me->timerManager->arm(pendingFrames[index].timerEntry);
+	// Start timeout from the timer pool (no allocation per request); it comes
+	// back to this AO as a time event carrying the correlation ID
+	timer_handle_t timeout = me->timerManager->oneshot_event(100, &me->super,
+			CAN_TIMEOUT(frame->meta.correlationId), false);
+	if (timeout == TIMER_HANDLE_INVALID) {
+		ao_can_publish_timeout(*frame);
+		return;
 	}
 
-	// Move tail forward (circular buffer logic)
-	tail = (tail + 1) % MAX_PENDING_FRAMES;
-	count++;
+	memcpy(&pendingFrames[index].frame, frame, sizeof(message_frame_t));
+	pendingFrames[index].timeout = timeout;
+	pendingFrames[index].seq = ++sendSeq;
+	pendingFrames[index].in_use = 1;
 
 	// Send CAN frame
 	llce_can_write(frame->type, *frame);
 }
 
+/**
+ * @brief Publishes the timeout message for a request frame.
+ *
+ * @param frame The request that got no response.
+ */
+void ao_can_publish_timeout(message_frame_t frame) {
+#ifdef _WIN32
+	printf("Timeout: CAN ID %X, Correlation ID %X\n", message_encode_can_id(&frame), frame.meta.correlationId);
+#endif
+	frame.mode = MESSAGE_MODE_INTERNAL;
+	frame.type = MESSAGE_TYPE_TIMEOUT;
+	broker_ptr = broker_ctor();
+	if (broker_ptr != NULL) {
+		broker_post(broker_ptr, frame, PRIMARY_QUEUE);
+	}
+}
+
 /**
  * @brief Handles CAN frame timeouts.
  *
- * Called when a frame timeout occurs, triggering a timeout message.
+ * Runs in the CAN AO's dispatch when a CAN_TIMEOUT time event arrives, so the
+ * timeout message is published from this AO's thread, not the timer's. The
+ * pending frame is looked up by correlation ID; none is found when the
+ * response cleared it after the event was already queued.
  *
- * @param context Pointer to the timeout entry.
+ * @param me Pointer to the CAN object.
+ * @param correlationId Correlation ID carried by the time event.
  */
-void ao_can_timeout(void *context) {
-	can_timeout_entry_t *entry = (can_timeout_entry_t*) context;
-	if (entry != NULL) {
-#ifdef _WIN32
-        printf("Timeout: CAN ID %X, Correlation ID %X\n", message_encode_can_id(&entry->frame), entry->frame.meta.correlationId);
-#else
-		entry->frame.mode = MESSAGE_MODE_INTERNAL;
-		entry->frame.type = MESSAGE_TYPE_TIMEOUT;
-		broker_ptr = broker_ctor();
-		if (broker_ptr != NULL) {
-			broker_post(broker_ptr, entry->frame, PRIMARY_QUEUE);
+void ao_can_timeout(can_obj_t *me, uint32_t correlationId) {
+	(void) me;
+	for (uint8_t i = 0; i < MAX_PENDING_FRAMES; i++) {
+		can_timeout_entry_t *entry = &pendingFrames[i];
+		if (entry->in_use && (entry->frame.meta.correlationId & CAN_CORRELATION_MASK) == correlationId) {
+			message_frame_t frame = entry->frame;
+			entry->in_use = 0; // timer already fired, nothing to cancel
+			ao_can_publish_timeout(frame);
+			return;
 		}
-#endif
 	}
 }
 
 /**
  * @brief Clears a timeout entry when a response is received.
  *
- * Removes the corresponding entry from the circular buffer.
+ * Frees the matching slot of the pending table in place, so the other
+ * entries keep their position.
  *
  * @param me Pointer to the CAN object.
  * @param frame The received message frame that acknowledges a pending request.
  */
 void ao_can_clear_timeout(can_obj_t *me, message_frame_t frame) {
-	uint8_t i = head;
-	uint8_t processed = 0;
-
-	while (processed < count) {
-		if ((message_encode_can_id(&pendingFrames[i].frame) == message_encode_can_id(&frame)) && (pendingFrames[i].frame.meta.correlationId == frame.meta.correlationId)) {
-
-			if (pendingFrames[i].timerEntry) {
-				me->timerManager->disarm(pendingFrames[i].timerEntry);
-				me->timerManager->remove_callback(TIMER_100ms, ao_can_timeout, pendingFrames[i].timerEntry->context);
-				pendingFrames[i].timerEntry = NULL;
-			}
-
-			// Shift remaining entries forward
-			uint8_t j = i;
-			while (j != tail) {
-				uint8_t next = (j + 1) % MAX_PENDING_FRAMES;
-				pendingFrames[j] = pendingFrames[next];
-				j = next;
-			}
-
-			// Update tail and count
-			tail = (tail == 0) ? MAX_PENDING_FRAMES - 1 : tail - 1;
-			count--;
+	for (uint8_t i = 0; i < MAX_PENDING_FRAMES; i++) {
+		can_timeout_entry_t *entry = &pendingFrames[i];
+		if (entry->in_use && (message_encode_can_id(&entry->frame) == message_encode_can_id(&frame)) && (entry->frame.meta.correlationId == frame.meta.correlationId)) {
+			entry->in_use = 0;
+			me->timerManager->cancel(entry->timeout);
+			entry->timeout = TIMER_HANDLE_INVALID;
 			return;
 		}
-		i = (i + 1) % MAX_PENDING_FRAMES;
-		processed++;
 	}
 }
 #endif
@@ -24,6 +24,7 @@
 #include <cjson/cJSON.h>
 #include "ao_database.h"
 #include "broker.h"
+#include "json_writer.h"
 
 /// Path to the SQLite database file used by this active object.
 #define DATABASE_PATH "test.db"
@@ -31,6 +32,9 @@
 /// Maximum number of tables expected and validated at startup.
 #define MAX_TABLES	1
 
+/// Initial size of the buffer a table dump is written into (grown as needed).
+#define DB_JSON_INITIAL_SIZE	4096
+
 /**
  * @struct db_tables_t
  * @brief Metadata describing required database tables.
@@ -133,47 +137,47 @@ char* db_table_to_json(sqlite3 *db, const char *table) {
 		return NULL;
 	}
 
-	// Create JSON array
-	cJSON *array = cJSON_CreateArray();
+	// Stream rows straight into one growing buffer
+	json_writer_t w;
+	if (!json_writer_init_dynamic(&w, DB_JSON_INITIAL_SIZE)) {
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+	json_array_begin(&w);
 
 	// Iterate over each row
+	int col_count = sqlite3_column_count(stmt);
 	while (sqlite3_step(stmt) == SQLITE_ROW) {
-		cJSON *row = cJSON_CreateObject();
+		json_object_begin(&w);
 
-		int col_count = sqlite3_column_count(stmt);
 		for (int i = 0; i < col_count; i++) {
-			const char *col_name = sqlite3_column_name(stmt, i);
-			int col_type = sqlite3_column_type(stmt, i);
+			json_key(&w, sqlite3_column_name(stmt, i));
 
-			switch (col_type) {
+			switch (sqlite3_column_type(stmt, i)) {
 				case SQLITE_INTEGER:
-					cJSON_AddNumberToObject(row, col_name, sqlite3_column_int(stmt, i));
+					json_int(&w, sqlite3_column_int64(stmt, i));
 					break;
 				case SQLITE_FLOAT:
-					cJSON_AddNumberToObject(row, col_name, sqlite3_column_double(stmt, i));
-					break;
-				case SQLITE_TEXT:
-					cJSON_AddStringToObject(row, col_name, (const char*) sqlite3_column_text(stmt, i));
+					json_double(&w, sqlite3_column_double(stmt, i));
 					break;
 				case SQLITE_NULL:
-					cJSON_AddNullToObject(row, col_name);
+					json_null(&w);
 					break;
+				case SQLITE_TEXT:
 				default:
 					// Unknown type → fallback as string
-					cJSON_AddStringToObject(row, col_name, (const char*) sqlite3_column_text(stmt, i));
+					json_string_n(&w, (const char*) sqlite3_column_text(stmt, i),
+							sqlite3_column_bytes(stmt, i));
 					break;
 			}
 		}
-		cJSON_AddItemToArray(array, row);
+		json_object_end(&w);
 	}
 
 	sqlite3_finalize(stmt);
 
-	// Convert array to JSON string
-	char *json_str = cJSON_PrintUnformatted(array);
-	cJSON_Delete(array); // free JSON object
-
-	return json_str;
+	json_array_end(&w);
+	return json_writer_finish(&w, NULL);
 }
 
 /**
@@ -322,21 +326,21 @@ void on_exit_operational(fsm_t *fsm) {
 	broker_unsubscribe(((base_obj_t*) fsm->super)->broker, config, 1, ((base_obj_t*) fsm->super));
 }
 /* --- STATE DEFINITIONS --- */
-state_t db_initialisation_state = { .handler = db_initialisation_handler, .on_entry = on_enter_initialisation, .on_exit = NULL, .transitions = db_initialisation_transitions, .transition_count = 2 };
+state_t db_initialisation_state = { .handler = db_initialisation_handler, .on_entry = on_enter_initialisation, .on_exit = NULL, .transitions = db_initialisation_transitions, .transition_count = 2, .name = "db_initialisation" };
 
 /**
  * @brief Transition table for Operational State.
  *
  * Defines possible transitions from Operational to other states.
  */
-state_t db_operational_state = { .handler = db_operational_handler, .on_entry = on_enter_operational, .on_exit = on_exit_operational, .transitions = db_operational_transitions, .transition_count = 2 };
+state_t db_operational_state = { .handler = db_operational_handler, .on_entry = on_enter_operational, .on_exit = on_exit_operational, .transitions = db_operational_transitions, .transition_count = 2, .name = "db_operational" };
 
 /**
  * @brief Transition table for Error State.
  *
  * Defines possible transitions from Operational to other states.
  */
-state_t db_error_state = { .handler = db_error_handler, .on_entry = NULL, .on_exit = NULL, .transitions = db_error_transitions, .transition_count = 2 };
+state_t db_error_state = { .handler = db_error_handler, .on_entry = NULL, .on_exit = NULL, .transitions = db_error_transitions, .transition_count = 2, .name = "db_error" };
 
 /**
  * @brief Initialization state handler.
@@ -23,12 +23,15 @@
 #ifdef __linux__
 
 #include "ao_snmp.h"
+#include "ao_ws.h"
+#include "json_writer.h"
 
 #include <cjson/cJSON.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <syslog.h>
 
 /**
  * @def MAX_MIB_ENTRY
@@ -36,6 +39,13 @@
  */
 #define MAX_MIB_ENTRY        255
 
+/**
+ * @def SNMP_MIB_JSON_INITIAL_SIZE
+ * @brief Initial size of the buffer the MIB tree is serialized into;
+ *        grown as needed.
+ */
+#define SNMP_MIB_JSON_INITIAL_SIZE 16384
+
 /**
  * @def MSG_OID
  * @brief Extract a message identifier from an SNMP OID array.
@@ -115,7 +125,7 @@ static void* snmp_pump(void *arg);
 static mib_status_t add_mib_entry(mib_entry_t *entry);
 static mib_entry_t* find_mib_entry_by_msg_id(const uint16_t oid);
 static void tree_to_json(struct tree *subtree, const char *prefix,
-		cJSON *jarray);
+		json_writer_t *w);
 static bool register_from_json(snmp_agent_ao_t *me, const char *json_str);
 
 static void complete_get_cb(unsigned int clientreg, void *clientarg);
@@ -133,6 +143,8 @@ static void snmp_operational_handler(fsm_t *fsm, const message_frame_t *event);
 static void snmp_error_handler(fsm_t *fsm, const message_frame_t *event);
 static int snmp_log_callback(int major, int minor, void *serverarg,
 		void *clientarg);
+static void snmp_publish_log(snmp_agent_ao_t *me, int level, const char *msg);
+static void snmp_signal_self(fsm_t *fsm, const message_frame_t *evt);
 static void snmp_on_entry_initialisation(fsm_t *fsm);
 static void snmp_on_entry_operational(fsm_t *fsm);
 static void snmp_on_entry_error(fsm_t *fsm);
@@ -152,7 +164,7 @@ SNMP_CHANGE_STATE_INIT, &snmp_initialisation_state, NULL } };
 /* --- STATE DEFINITIONS --- */
 state_t snmp_initialisation_state = { .handler = NULL, .on_entry =
 		snmp_on_entry_initialisation, .on_exit = NULL, .transitions =
-		snmp_initialisation_transitions, .transition_count = 2 };
+		snmp_initialisation_transitions, .transition_count = 2, .name = "snmp_initialisation" };
 
 /**
  * @brief Transition table for Operational State.
@@ -161,7 +173,7 @@ state_t snmp_initialisation_state = { .handler = NULL, .on_entry =
  */
 state_t snmp_operational_state = { .handler = snmp_operational_handler,
 		.on_entry = snmp_on_entry_operational, .on_exit = NULL, .transitions =
-				snmp_operational_transitions, .transition_count = 2 };
+				snmp_operational_transitions, .transition_count = 2, .name = "snmp_operational" };
 
 /**
  * @brief Transition table for Error State.
@@ -170,39 +182,45 @@ state_t snmp_operational_state = { .handler = snmp_operational_handler,
  */
 state_t snmp_error_state = { .handler = snmp_error_handler, .on_entry =
 		snmp_on_entry_error, .on_exit = NULL, .transitions =
-		snmp_error_transitions, .transition_count = 1 };
+		snmp_error_transitions, .transition_count = 1, .name = "snmp_error" };
 
 /**
  * @brief Convert an SNMP MIB subtree into JSON representation.
  *
  * Recursively walk MIB tree and build JSON array
- * Traverses the given @p subtree and appends entries to the provided
- * JSON array. Each node is prefixed with @p prefix for naming context.
+ * Traverses the given @p subtree and writes entries into the
+ * JSON array open on @p w. Each node is prefixed with @p prefix for naming context.
  *
  * @param subtree Pointer to the SNMP tree subtree to convert.
  * @param prefix  String prefix applied to each node name.
- * @param jarray  JSON array object to which node objects are appended.
+ * @param w       JSON writer positioned inside an open array; one object is
+ *                written per leaf node.
  */
-void tree_to_json(struct tree *subtree, const char *prefix, cJSON *jarray) {
+void tree_to_json(struct tree *subtree, const char *prefix, json_writer_t *w) {
 	for (struct tree *t = subtree; t; t = t->next_peer) {
 		char newprefix[1024];
 		snprintf(newprefix, sizeof(newprefix), "%s.%lu", prefix, t->subid);
 
 		if (!t->child_list) {
-			/* Leaf node → build JSON object */
-			cJSON *jobj = cJSON_CreateObject();
-			cJSON_AddStringToObject(jobj, "oid", newprefix);
-			cJSON_AddStringToObject(jobj, "name", t->label ? t->label : "");
-			cJSON_AddNumberToObject(jobj, "asn_type", t->type);
-			cJSON_AddNumberToObject(jobj, "access", t->access);
-			if (t->description)
-				cJSON_AddStringToObject(jobj, "descr", t->description);
-
-			cJSON_AddItemToArray(jarray, jobj);
+			/* Leaf node → write JSON object */
+			json_object_begin(w);
+			json_key(w, "oid");
+			json_string(w, newprefix);
+			json_key(w, "name");
+			json_string(w, t->label ? t->label : "");
+			json_key(w, "asn_type");
+			json_int(w, t->type);
+			json_key(w, "access");
+			json_int(w, t->access);
+			if (t->description) {
+				json_key(w, "descr");
+				json_string(w, t->description);
+			}
+			json_object_end(w);
 		}
 
 		if (t->child_list) {
-			tree_to_json(t->child_list, newprefix, jarray);
+			tree_to_json(t->child_list, newprefix, w);
 		}
 	}
 }
@@ -327,11 +345,64 @@ mib_entry_t* find_mib_entry_by_msg_id(const uint16_t oid) {
 	return NULL; /* not found */
 }
 
+/**
+ * @brief Writes one dashboard log record, as read by the web UI's log.js.
+ *
+ * @param w     Writer to fill.
+ * @param level Log level (1 normal, 2 alarm, 3 warning, 4 ok).
+ * @param msg   Message text; the trailing newline is dropped.
+ */
+static void snmp_write_log(json_writer_t *w, int level, const char *msg) {
+	char line[WS_LIVE_REC_MAX];
+	size_t n = strlen(msg);
+	while (n && (msg[n - 1] == '\n' || msg[n - 1] == '\r'))
+		n--;
+	snprintf(line, sizeof(line), "SNMP:: %.*s", (int) n, msg);
+	json_object_begin(w);
+	json_key(w, "level");
+	json_int(w, level);
+	json_key(w, "time");
+	json_uint(w, get_time_ms() / 1000);
+	json_key(w, "log");
+	json_string(w, line);
+	json_object_end(w);
+}
+
+/**
+ * @brief Publishes a log line to the web dashboard's log document.
+ *
+ * The record goes out as WS_LIVE_UPDATE(WS_DOC_LOG, 0), in the payload when
+ * it fits, else in ptr, which the WS AO takes over and frees.
+ *
+ * @param me    Pointer to the SNMP agent active object instance.
+ * @param level Log level (1 normal, 2 alarm, 3 warning, 4 ok).
+ * @param msg   Message text.
+ */
+static void snmp_publish_log(snmp_agent_ao_t *me, int level, const char *msg) {
+	message_frame_t evt = { .signal = WS_LIVE_UPDATE(WS_DOC_LOG, 0) };
+	json_writer_t w;
+	size_t len;
+
+	json_writer_init(&w, (char*) evt.payload, sizeof(evt.payload));
+	snmp_write_log(&w, level, msg);
+	if (!json_writer_finish(&w, &len)) {
+		if (!json_writer_init_dynamic(&w, WS_LIVE_REC_MAX))
+			return;
+		snmp_write_log(&w, level, msg);
+		evt.ptr = (uint8_t*) json_writer_finish(&w, &len);
+		if (!evt.ptr)
+			return;
+	}
+	evt.length = (uint32_t) len;
+	broker_post(me->super.broker, evt, PRIMARY_QUEUE);
+}
+
 /**
  * @brief Callback for Net-SNMP log messages.
  *
  * Receives log events from the Net-SNMP library and forwards them
- * to the application’s logging system or broker.
+ * to the application’s logging system or broker. Notices and above are
+ * also published to the web dashboard's log.
  *
  * @param major     Major identifier of the log event type.
  * @param minor     Minor identifier providing additional context.
@@ -357,15 +428,20 @@ int snmp_log_callback(int major, int minor, void *serverarg, void *clientarg) {
 
 	if (strstr(msg, "AgentX subagent connected")) {
 		me->agent_inited = 1;
-		// post log to broker
+		snmp_publish_log(me, 4, msg);
 	} else if (strstr(msg, "AgentX master disconnected us")
 			|| strstr(msg, "Failed to connect to the agentx master agent")
 			|| strstr(msg, "AgentX master agent failed to respond to ping")) {
 		me->agent_inited = 0;
+		snmp_publish_log(me, 2, msg);
 		message_frame_t evt = { .signal = SNMP_CHANGE_STATE_ERR(0) };
 		memcpy(evt.payload, msg, strlen(msg));
 		evt.length = strlen(msg);
 		post((base_obj_t*) me, evt); // Signal self to transition to error state
+	} else if (m->priority <= LOG_NOTICE) {
+		snmp_publish_log(me,
+				m->priority <= LOG_ERR ? 2 : (m->priority == LOG_WARNING ? 3 : 1),
+				msg);
 	}
 	return 1;
 }
@@ -595,11 +671,16 @@ bool snmp_agent_init(snmp_agent_ao_t *me) {
 		me->agent_inited = 0;
 		return false;
 	}
-	cJSON *jarray = cJSON_CreateArray();
-
-	tree_to_json(root, "", jarray);
+	json_writer_t w;
+	if (!json_writer_init_dynamic(&w, SNMP_MIB_JSON_INITIAL_SIZE)) {
+		me->agent_inited = 0;
+		return false;
+	}
+	json_array_begin(&w);
+	tree_to_json(root, "", &w);
+	json_array_end(&w);
 	//add validation of json array
-	char *outstr = cJSON_Print(jarray);
+	char *outstr = json_writer_finish(&w, NULL);
 	if (outstr == NULL) {
 		me->agent_inited = 0;
 		return false;
@@ -607,7 +688,6 @@ bool snmp_agent_init(snmp_agent_ao_t *me) {
 
 	register_from_json(me, outstr);
 
-	cJSON_Delete(jarray);
 	free(outstr);
 	free(root);
 
@@ -759,6 +839,21 @@ void snmp_agent_send_trap(const snmp_agent_ao_t *me, const char *trap_oid_str) {
 	snmp_free_varbind(vars);
 }
 
+/**
+ * @brief Signals the FSM from one of its own actions.
+ *
+ * The event goes to the FSM's internal queue, or to the head of the AO queue
+ * should the internal queue be full. post() is not used: it blocks while the
+ * AO queue is full, and only this thread drains it.
+ *
+ * @param fsm Pointer to the FSM instance for this AO.
+ * @param evt Event to deliver (copied).
+ */
+static void snmp_signal_self(fsm_t *fsm, const message_frame_t *evt) {
+	if (!fsm_post_internal(fsm, evt))
+		(void) try_post((base_obj_t*) fsm->super, evt, 1);
+}
+
 /**
  * @brief FSM entry action for the SNMP agent’s initialization state.
  *
@@ -769,8 +864,9 @@ void snmp_agent_send_trap(const snmp_agent_ao_t *me, const char *trap_oid_str) {
  *
  * @param fsm Pointer to the FSM instance for this AO.
  *
- * @note state transition signals are posted directly to itself
- * using base function post() from active_object
+ * @note state transition signals are posted to the FSM's internal queue
+ * with snmp_signal_self(), so they run to completion before the next
+ * broker message is dispatched.
  */
 void snmp_on_entry_initialisation(fsm_t *fsm) {
 	// On Enter initiaisation, ao subscribs to SNMP_CHANGE_STATE_OP and SNMP_CHANGE_STATE_ERR
@@ -784,7 +880,7 @@ void snmp_on_entry_initialisation(fsm_t *fsm) {
 			((base_obj_t*) fsm->super));
 	if (!snmp_agent_init(me)) {
 		evt.signal = SNMP_CHANGE_STATE_ERR(0); // Signal self to transition to ERROR state
-		post(((base_obj_t*) me), evt);
+		snmp_signal_self(fsm, &evt);
 		return;
 	}
 	if (!me->pump_running) {
@@ -794,13 +890,13 @@ void snmp_on_entry_initialisation(fsm_t *fsm) {
 			me->agent_inited = 0;
 			snmp_agent_shutdown(me);
 			evt.signal = SNMP_CHANGE_STATE_ERR(0); // Signal self to transition to ERROR state
-			post(((base_obj_t*) me), evt);
+			snmp_signal_self(fsm, &evt);
 			return;
 		}
 		while (me->pump_tid == 0)
 			; // Wait for the agent thread pump to be running
 		evt.signal = SNMP_CHANGE_STATE_OP; // Signal self to transition to OPERATIONAL state
-		post(((base_obj_t*) me), evt);
+		snmp_signal_self(fsm, &evt);
 	}
 }
 
@@ -259,23 +259,23 @@ TRANSIT(0, initialisation_state, NULL) };
 /* --- STATE DEFINITIONS --- */
 struct state initialisation_state = { .handler = NULL, .on_entry =
 		on_enter_initialisation, .on_exit = on_exit_initialisation,
-		.transitions = initialisation_transitions, .transition_count = 2 };
+		.transitions = initialisation_transitions, .transition_count = 2, .name = "initialisation" };
 
 struct state operational_state = { .handler = NULL, .on_entry =
 		on_enter_operational, .on_exit = on_exit_operational, .transitions =
-		operational_transitions, .transition_count = 2 };
+		operational_transitions, .transition_count = 2, .name = "operational" };
 
 struct state error_state = { .handler = NULL, .on_entry = on_enter_error,
 		.on_exit = on_exit_error, .transitions = error_transitions,
-		.transition_count = 3 };
+		.transition_count = 3, .name = "error" };
 
 struct state loader_state = { .handler = NULL, .on_entry = on_enter_loader,
 		.on_exit = on_exit_loader, .transitions = loader_transitions,
-		.transition_count = 2 };
+		.transition_count = 2, .name = "loader" };
 
 struct state maintenance_state = { .handler = NULL, .on_entry =
 		on_enter_maintenance, .on_exit = on_exit_maintenance, .transitions =
-		maintenance_transitions, .transition_count = 4 };
+		maintenance_transitions, .transition_count = 4, .name = "maintenance" };
 
 /**
  * @brief Dispatches incoming messages to the FSM.
@@ -8,8 +8,9 @@
  * The watchdog periodically checks system health and can take corrective action
  * if a component fails to send a heartbeat within the defined timeout.
  *
- * The implementation supports both Windows (via system timers) and FreeRTOS
- * (via task scheduling).
+ * Both periodic jobs are time events: the system timer posts
+ * WDG_TIME_HEARTBEAT and WDG_TIME_MONITOR to the watchdog's own queue, so
+ * they run on the watchdog thread rather than on the timer thread.
  *
  * @author Nathan Ikolo
  * @date March 2, 2025
@@ -44,7 +45,7 @@ static void heartbeat(void *context);
 /**
  * @brief Periodic heartbeat sender.
  *
- * This function is triggered every 10ms. It posts a SYSTEM_TIME_EVENT
+ * This function runs every 10ms on WDG_TIME_HEARTBEAT. It posts a SYSTEM_TIME_EVENT
  * to the message broker to signal system activity.
  *
  * @param context Pointer to the broker instance.
@@ -80,13 +81,16 @@ watchdog_obj_t* watchdog_ctor(broker_t *broker, char *name) {
 		me->timer = timer_ctor();
 
 		/* Schedule heartbeat transmission every 10ms */
-		timer_callback_entry_t *entry_heartbeat = me->timer->add_callback(
-				TIMER_10ms, heartbeat, broker, 1,false);
+		timer_callback_entry_t *entry_heartbeat = me->timer->add_event(10,
+				&me->super, WDG_TIME_HEARTBEAT, false, false);
 		me->timer->arm(entry_heartbeat);
 
-		/* Schedule heartbeat monitoring every 100ms */
-		timer_callback_entry_t *entry_checkbeat = me->timer->add_callback(
-				TIMER_100ms, heartbeat_monitor_callback, NULL, 1,false);
+		/* Schedule heartbeat monitoring every 100ms, ahead of queued traffic.
+		 * The check is coarse next to HEARTBEAT_TIMEOUT, so let it share a
+		 * wake-up with other timers. */
+		timer_callback_entry_t *entry_checkbeat = me->timer->add_event(100,
+				&me->super, WDG_TIME_MONITOR, true, false);
+		me->timer->set_slack(entry_checkbeat, 20);
 		me->timer->arm(entry_checkbeat);
 	}
 	return me;
@@ -96,7 +100,8 @@ watchdog_obj_t* watchdog_ctor(broker_t *broker, char *name) {
  * @brief Dispatch function to handle incoming messages.
  *
  * This function updates the last heartbeat timestamp when a
- * SYSTEM_TIME_EVENT is received.
+ * SYSTEM_TIME_EVENT is received, and runs the periodic jobs on their
+ * time events.
  *
  * @param me Pointer to the active object instance.
  * @param frame Pointer to the received message frame.
@@ -110,6 +115,12 @@ static void dispatch(base_obj_t *const me, const message_frame_t *frame) {
             me->last_heartbeat_time = xTaskGetTickCount();
 #endif
 		break;
+	case WDG_TIME_HEARTBEAT:
+		heartbeat(me->broker);
+		break;
+	case WDG_TIME_MONITOR:
+		heartbeat_monitor_callback(NULL);
+		break;
 	}
 }
 
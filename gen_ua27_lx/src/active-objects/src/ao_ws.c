@@ -1,9 +1,12 @@
 // ao_ws.c — epoll-based HTTP (static files) + WebSocket AO (multi-client)
 // Fixes: proper PING/PONG handling, no close on zero-length/control frames.
 //
-// Link: -lssl -lcrypto -lpthread
+// Link: -lssl -lcrypto -lpthread -lz
 // Requires your framework headers: active_object.h, fsm.h, broker.h, message.h
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* strptime, timegm */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,27 +18,54 @@
 #include <arpa/inet.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <limits.h>
+#include <time.h>
 
 #include <openssl/sha.h>
 #include <openssl/bio.h>
 #include <openssl/evp.h>
 
+#include <zlib.h>
+
 #include <cjson/cJSON.h>
 
 #include "ao_ws.h"
+#include "sys_timer.h"
+#include "json_writer.h"
 
 /* ------------------ small helpers ------------------ */
 static int set_nonblock(int fd) {
 	int f = fcntl(fd, F_GETFL, 0);
 	return fcntl(fd, F_SETFL, f | O_NONBLOCK);
 }
-static void ep_add(int ep, int fd, uint32_t ev) {
-	struct epoll_event e = { .events = ev, .data.fd = fd };
+static uint64_t ws_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000u + (uint64_t) ts.tv_nsec / 1000000u;
+}
+/* epoll tags: a client is tagged (generation << 32 | slot) so the pump finds it
+ * without a scan and can drop events queued before the slot was reused; the
+ * listener and the eventfd use tags no client slot can produce. */
+#define WS_TAG_LISTEN  UINT64_MAX
+#define WS_TAG_NOTIFY  (UINT64_MAX - 1)
+#define WS_TAG_INOTIFY (UINT64_MAX - 2)
+static inline uint64_t ws_tag(const ao_ws_t *me, int idx) {
+	return ((uint64_t) me->clients[idx].gen << 32) | (uint32_t) idx;
+}
+/* Reactor owning client slot @p idx (partitions are equal but the last) */
+static inline ws_reactor_t* ws_reactor(ao_ws_t *me, int idx) {
+	return &me->reactor[idx / me->reactor[0].count];
+}
+static void ep_add(int ep, int fd, uint32_t ev, uint64_t tag) {
+	struct epoll_event e = { .events = ev, .data.u64 = tag };
 	epoll_ctl(ep, EPOLL_CTL_ADD, fd, &e);
 }
-static void ep_mod(int ep, int fd, uint32_t ev) {
-	struct epoll_event e = { .events = ev, .data.fd = fd };
+static void ep_mod(int ep, int fd, uint32_t ev, uint64_t tag) {
+	struct epoll_event e = { .events = ev, .data.u64 = tag };
 	epoll_ctl(ep, EPOLL_CTL_MOD, fd, &e);
 }
 static void ep_del(int ep, int fd) {
@@ -49,6 +79,22 @@ static void ws_on_entry_operational(fsm_t *fsm);
 static void ws_on_entry_error(fsm_t *fsm);
 static void ws_operational_handler(fsm_t *fsm, const message_frame_t *ev);
 static void ws_parse_json(const char *json_str, message_frame_t *msg);
+static void ws_cmd_push(ao_ws_t *me, int target_idx, const char *text);
+static void ws_cmd_push_text(ao_ws_t *me, int target_idx, const char *text,
+		size_t len);
+static void ws_cmd_push_frame(ao_ws_t *me, int target_idx, uint8_t opcode,
+		uint8_t cls, uint32_t key, const void *p, size_t len);
+static void ws_cmd_queue(ws_reactor_t *r, int target_idx, struct ws_frame *f);
+static void ws_cmd_push_to(ao_ws_t *me, struct ws_frame *f);
+static void ws_send_trace(ao_ws_t *me, int idx, const char *ao_name);
+static void ws_send_timers(ao_ws_t *me, int idx);
+static void ws_send_clients(ao_ws_t *me, int idx);
+static size_t ws_json_str(const message_frame_t *msg, char *out, size_t cap);
+static int ws_rd_feed(ao_ws_t *me, int idx, const uint8_t *p, size_t n);
+static void ws_client_lost(ao_ws_t *me, int idx);
+static void ws_pump_post(ao_ws_t *me, message_frame_t *e);
+static int ws_upgraded(ao_ws_t *me, int idx);
+static int ws_flush(ao_ws_t *me, int idx);
 
 static transition_t ws_initialisation_transitions[] = { { WS_CHANGE_STATE_OP,
 		&ws_operational_state, NULL }, { WS_CHANGE_STATE_ERR, &ws_error_state,
@@ -62,50 +108,222 @@ state_t ws_initialisation_state = { .handler = NULL, .on_entry =
 		ws_on_entry_initialisation, .on_exit = NULL, .transitions =
 		ws_initialisation_transitions, .transition_count =
 		sizeof(ws_initialisation_transitions)
-				/ sizeof(ws_initialisation_transitions[0]) };
+				/ sizeof(ws_initialisation_transitions[0]), .name = "ws_initialisation" };
 state_t ws_operational_state = { .handler = ws_operational_handler, .on_entry =
 		ws_on_entry_operational, .on_exit = NULL, .transitions =
 		ws_operational_transitions, .transition_count =
 		sizeof(ws_operational_transitions)
-				/ sizeof(ws_operational_transitions[0]) };
+				/ sizeof(ws_operational_transitions[0]), .name = "ws_operational" };
 state_t ws_error_state = { .handler = NULL, .on_entry = ws_on_entry_error,
 		.on_exit = NULL, .transitions = ws_error_transitions,
 		.transition_count = sizeof(ws_error_transitions)
-				/ sizeof(ws_error_transitions[0]) };
+				/ sizeof(ws_error_transitions[0]), .name = "ws_error" };
 
 /* ======================= HTTP helpers ======================= */
-static int http_is_upgrade(const char *req) {
-	return strstr(req, "Upgrade: websocket") != NULL;
+/* Incremental request parser. http_parse() resumes where the last read left
+ * off, looks at each byte once, and records slices into c->rx instead of
+ * copying. Returns 1 with a complete request (c->req.line bytes long), 0 when
+ * it needs more input, or an HP_ERR_* code. */
+enum {
+	HP_REQ_LINE = 0,
+	HP_HEADERS,
+	HP_BODY,
+	HP_CHUNK_SIZE,
+	HP_CHUNK_DATA,
+	HP_TRAILER,
+	HP_DONE
+};
+#define HP_ERR_BAD  (-1) /* malformed: 400 */
+#define HP_ERR_BIG  (-2) /* does not fit rx: 431 or 413 */
+#define HP_ERR_BODY (-3) /* declared body or chunk does not fit rx: 413 */
+
+static int hp_more(const ws_client_t *c) {
+	return c->rx_len >= WS_RX_BUFSZ - 1 ? HP_ERR_BIG : 0;
 }
-static int http_get_header(const char *req, const char *key, char *out,
-		size_t outsz) {
-	const char *p = strstr(req, key);
-	if (!p)
-		return 0;
-	p += strlen(key);
-	while (*p == ' ' || *p == '\t')
-		p++;
-	size_t i = 0;
-	while (*p && *p != '\r' && *p != '\n' && i + 1 < outsz)
-		out[i++] = *p++;
-	out[i] = '\0';
-	return 1;
+/* Length of the next line without its CR/LF, or -1 until its LF arrives */
+static long hp_line(ws_client_t *c) {
+	ws_http_req_t *r = &c->req;
+	const char *nl = memchr(c->rx + r->scan, '\n', c->rx_len - r->scan);
+	if (!nl) {
+		r->scan = (uint32_t) c->rx_len;
+		return -1;
+	}
+	uint32_t end = (uint32_t) (nl - c->rx);
+	r->scan = end + 1;
+	if (end > r->line && c->rx[end - 1] == '\r')
+		end--;
+	return (long) (end - r->line);
 }
-static int http_get_path(const char *req, char *out, size_t outsz) {
-	const char *p = strstr(req, "GET ");
-	if (!p)
-		return 0;
-	p += 4;
-	const char *sp = strchr(p, ' ');
-	if (!sp)
+/* Case-insensitive search for @p tok inside a header value */
+static int hp_has_token(const char *v, size_t n, const char *tok) {
+	size_t t = strlen(tok);
+	for (size_t i = 0; i + t <= n; i++)
+		if (!strncasecmp(v + i, tok, t))
+			return 1;
+	return 0;
+}
+static int hp_is(const ws_client_t *c, ws_slice_t s, const char *lit) {
+	size_t n = strlen(lit);
+	return s.len == n && !strncasecmp(c->rx + s.off, lit, n);
+}
+static int http_parse(ws_client_t *c) {
+	ws_http_req_t *r = &c->req;
+	char *rx = c->rx;
+	for (;;) {
+		long n;
+		const char *p;
+		switch (r->state) {
+		case HP_REQ_LINE: {
+			if ((n = hp_line(c)) < 0)
+				return hp_more(c);
+			p = rx + r->line;
+			if (n == 0) { /* tolerate stray CRLF between requests */
+				r->line = r->scan;
+				continue;
+			}
+			const char *e = p + n;
+			const char *sp1 = memchr(p, ' ', (size_t) n);
+			const char *sp2 = sp1 ? memchr(sp1 + 1, ' ', (size_t) (e - sp1 - 1)) : NULL;
+			if (!sp2 || sp1 == p || sp2 == sp1 + 1 || e - sp2 != 9
+					|| strncmp(sp2 + 1, "HTTP/1.", 7) || sp2[8] < '0'
+					|| sp2[8] > '9')
+				return HP_ERR_BAD;
+			r->method = (ws_slice_t ) { r->line, (uint32_t) (sp1 - p) };
+			r->target = (ws_slice_t ) { (uint32_t) (sp1 + 1 - rx),
+							(uint32_t) (sp2 - sp1 - 1) };
+			r->minor = (uint8_t) (sp2[8] - '0');
+			r->line = r->scan;
+			r->state = HP_HEADERS;
+			continue;
+		}
+		case HP_HEADERS: {
+			if ((n = hp_line(c)) < 0)
+				return hp_more(c);
+			p = rx + r->line;
+			if (n == 0) {
+				r->line = r->body = r->scan;
+				r->state = r->chunked ? HP_CHUNK_SIZE :
+							r->need ? HP_BODY : HP_DONE;
+				continue;
+			}
+			const char *colon = memchr(p, ':', (size_t) n);
+			/* no name, whitespace before the colon, or obsolete folding */
+			if (!colon || colon == p || colon[-1] == ' ' || colon[-1] == '\t'
+					|| *p == ' ' || *p == '\t')
+				return HP_ERR_BAD;
+			if (r->nhdr >= WS_HTTP_MAX_HEADERS)
+				return HP_ERR_BIG;
+			const char *v = colon + 1, *e = p + n;
+			while (v < e && (*v == ' ' || *v == '\t'))
+				v++;
+			while (e > v && (e[-1] == ' ' || e[-1] == '\t'))
+				e--;
+			ws_slice_t name = { r->line, (uint32_t) (colon - p) };
+			ws_slice_t val = { (uint32_t) (v - rx), (uint32_t) (e - v) };
+			if (hp_is(c, name, "Content-Length")) {
+				uint64_t len = 0;
+				if (v == e)
+					return HP_ERR_BAD;
+				for (; v < e; v++) {
+					if (*v < '0' || *v > '9')
+						return HP_ERR_BAD;
+					len = len * 10 + (uint64_t) (*v - '0');
+					if (len >= WS_RX_BUFSZ)
+						return HP_ERR_BODY;
+				}
+				r->need = (uint32_t) len;
+			} else if (hp_is(c, name, "Transfer-Encoding")) {
+				r->chunked = (uint8_t) hp_has_token(rx + val.off, val.len,
+						"chunked");
+			}
+			r->name[r->nhdr] = name;
+			r->value[r->nhdr] = val;
+			r->nhdr++;
+			r->line = r->scan;
+			continue;
+		}
+		case HP_BODY:
+			if (c->rx_len - r->body < r->need)
+				return hp_more(c);
+			r->body_len = r->need;
+			r->line = r->scan = r->body + r->need;
+			r->state = HP_DONE;
+			continue;
+		case HP_CHUNK_SIZE: {
+			if ((n = hp_line(c)) < 0)
+				return hp_more(c);
+			p = rx + r->line;
+			uint64_t len = 0;
+			long i = 0;
+			for (; i < n && p[i] != ';'; i++) {
+				int d = (p[i] >= '0' && p[i] <= '9') ? p[i] - '0' :
+						(p[i] >= 'a' && p[i] <= 'f') ? p[i] - 'a' + 10 :
+						(p[i] >= 'A' && p[i] <= 'F') ? p[i] - 'A' + 10 : -1;
+				if (d < 0)
+					return HP_ERR_BAD;
+				len = (len << 4) | (uint64_t) d;
+				if (len >= WS_RX_BUFSZ)
+					return HP_ERR_BODY;
+			}
+			if (i == 0)
+				return HP_ERR_BAD;
+			r->need = (uint32_t) len;
+			r->line = r->scan;
+			r->state = len ? HP_CHUNK_DATA : HP_TRAILER;
+			continue;
+		}
+		case HP_CHUNK_DATA:
+			if (c->rx_len - r->line < (size_t) r->need + 2)
+				return hp_more(c);
+			if (rx[r->line + r->need] != '\r'
+					|| rx[r->line + r->need + 1] != '\n')
+				return HP_ERR_BAD;
+			/* decode in place: slide the chunk down against the body so far */
+			memmove(rx + r->body + r->body_len, rx + r->line, r->need);
+			r->body_len += r->need;
+			r->line = r->scan = r->line + r->need + 2;
+			r->state = HP_CHUNK_SIZE;
+			continue;
+		case HP_TRAILER:
+			if ((n = hp_line(c)) < 0)
+				return hp_more(c);
+			r->line = r->scan;
+			if (n == 0)
+				r->state = HP_DONE;
+			continue;
+		default:
+			return 1;
+		}
+	}
+}
+/* Value of header @p name in the parsed request, or NULL */
+static const char* http_header(const ws_client_t *c, const char *name,
+		size_t *len) {
+	for (int i = 0; i < c->req.nhdr; i++)
+		if (hp_is(c, c->req.name[i], name)) {
+			*len = c->req.value[i].len;
+			return c->rx + c->req.value[i].off;
+		}
+	return NULL;
+}
+/* Header value copied out NUL-terminated (and truncated) for libc parsers */
+static int http_header_copy(const ws_client_t *c, const char *name, char *out,
+		size_t outsz) {
+	size_t n;
+	const char *v = http_header(c, name, &n);
+	if (!v)
 		return 0;
-	size_t n = (size_t) (sp - p);
 	if (n >= outsz)
 		n = outsz - 1;
-	memcpy(out, p, n);
+	memcpy(out, v, n);
 	out[n] = '\0';
 	return 1;
 }
+static int http_is_upgrade(const ws_client_t *c) {
+	size_t n;
+	const char *v = http_header(c, "Upgrade", &n);
+	return v && hp_has_token(v, n, "websocket");
+}
 static void sanitize_path(char *path) {
 	char *q = strchr(path, '?');
 	if (q)
@@ -172,361 +390,1759 @@ static char* ws_accept_from_key(const char *client_key) {
 	return out;
 }
 
-/* server->client text frame (unmasked) */
-static int ws_send_text(int fd, const char *msg) {
-	size_t len = strlen(msg);
-	unsigned char h[2 + 8];
-	size_t hlen = 0;
-	h[hlen++] = 0x81; /* FIN=1, text */
-	if (len <= 125) {
-		h[hlen++] = (unsigned char) len;
-	} else if (len <= 0xFFFF) {
-		h[hlen++] = 126;
-		h[hlen++] = (unsigned char) (len >> 8);
-		h[hlen++] = (unsigned char) len;
+/* Encoded server->client frame (unmasked, FIN=1), header included. The AO
+ * thread encodes it once and hands it to the pump through the command queue;
+ * from there it is queued by reference on every target client and freed with
+ * the last reference. A broadcast is shared by every reactor, so refs are
+ * atomic. */
+#define WS_TO_MASK  (-2) /* command target: the clients set in ws_frame_t::to */
+#define WS_TO_WORDS ((WS_MAX_CLIENTS + 63) / 64)
+typedef struct ws_frame {
+	uint32_t refs;
+	uint32_t len;
+	uint8_t cls; /* ws_msg_class_t, for the send policy */
+	uint32_t key; /* conflation key, 0: none */
+	uint64_t to[WS_TO_WORDS]; /* WS_TO_MASK targets, by client slot */
+	unsigned char buf[];
+} ws_frame_t;
+
+static ws_frame_t* ws_frame_new(uint8_t opcode, const void *p, size_t len) {
+	size_t hlen = len <= 125 ? 2 : len <= 0xFFFF ? 4 : 10;
+	ws_frame_t *f = malloc(sizeof(*f) + hlen + len);
+	if (!f)
+		return NULL;
+	f->refs = 1;
+	f->len = (uint32_t) (hlen + len);
+	f->cls = WS_MSG_REPLY;
+	f->key = 0;
+	memset(f->to, 0, sizeof(f->to));
+	f->buf[0] = (unsigned char) (0x80 | opcode);
+	if (hlen == 2) {
+		f->buf[1] = (unsigned char) len;
+	} else if (hlen == 4) {
+		f->buf[1] = 126;
+		f->buf[2] = (unsigned char) (len >> 8);
+		f->buf[3] = (unsigned char) len;
 	} else {
-		h[hlen++] = 127;
-		for (int i = 7; i >= 0; i--)
-			h[hlen++] = (unsigned char) ((len >> (i * 8)) & 0xFF);
+		f->buf[1] = 127;
+		for (int i = 0; i < 8; i++)
+			f->buf[2 + i] = (unsigned char) ((uint64_t) len >> ((7 - i) * 8));
 	}
-	if (write(fd, h, (int) hlen) < 0)
-		return -1;
-	if (len && write(fd, msg, len) < 0)
+	memcpy(f->buf + hlen, p, len);
+	return f;
+}
+static inline void ws_frame_to_set(ws_frame_t *f, int idx) {
+	f->to[idx >> 6] |= 1ull << (idx & 63);
+}
+static inline int ws_frame_to_has(const ws_frame_t *f, int idx) {
+	return (int) ((f->to[idx >> 6] >> (idx & 63)) & 1u);
+}
+static void ws_frame_get(ws_frame_t *f) {
+	__atomic_add_fetch(&f->refs, 1, __ATOMIC_RELAXED);
+}
+static void ws_frame_put(ws_frame_t *f) {
+	if (f && __atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(f);
+}
+
+/* Publish the queue depth of @p c for WS_CLIENTS_QUERY */
+static void outq_stats(ws_client_t *c) {
+	int depth = c->out_cap ?
+			(c->out_tail - c->out_head + c->out_cap) % c->out_cap : 0;
+	__atomic_store_n(&c->out_st.depth, (uint32_t) depth, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->out_st.bytes, (uint32_t) c->out_bytes,
+			__ATOMIC_RELAXED);
+	if (c->out_bytes > c->out_st.peak) /* only this reactor writes it */
+		__atomic_store_n(&c->out_st.peak, (uint32_t) c->out_bytes,
+				__ATOMIC_RELAXED);
+}
+static void outq_stats_reset(ws_client_t *c) {
+	__atomic_store_n(&c->out_st.depth, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->out_st.bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->out_st.peak, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->out_st.dropped, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->out_st.conflated, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->out_st.stall_ms, 0, __ATOMIC_RELAXED);
+}
+/* @p c is backlogged: start its WS_OUT_STALL_MS clock unless running */
+static void outq_stalled(ws_client_t *c) {
+	if (!c->out_st.stall_ms)
+		__atomic_store_n(&c->out_st.stall_ms, ws_now_ms(), __ATOMIC_RELAXED);
+}
+
+/* Queue a reference to @p f, growing the ring as needed while the bytes
+ * waiting stay within WS_OUT_BUDGET. Returns -1 when over budget. */
+static int outq_push(ws_client_t *c, ws_frame_t *f, uint32_t key) {
+	if (c->out_bytes + f->len > WS_OUT_BUDGET)
 		return -1;
+	int n = c->out_cap ? (c->out_tail + 1) % c->out_cap : 0;
+	if (!c->out_cap || n == c->out_head) {
+		int cap = c->out_cap ? c->out_cap * 2 : WS_OUTQ_LEN;
+		ws_out_t *q = malloc((size_t) cap * sizeof(*q));
+		if (!q)
+			return -1;
+		int k = 0; /* unwrap the old ring at the front of the new one */
+		for (int i = c->out_head; i != c->out_tail; i = (i + 1) % c->out_cap)
+			q[k++] = c->out_q[i];
+		free(c->out_q);
+		c->out_q = q;
+		c->out_cap = cap;
+		c->out_head = 0;
+		c->out_tail = k;
+		n = k + 1;
+	}
+	ws_frame_get(f);
+	c->out_q[c->out_tail].f = f;
+	c->out_q[c->out_tail].off = 0;
+	c->out_q[c->out_tail].key = key;
+	c->out_tail = n;
+	c->out_bytes += f->len;
+	outq_stats(c);
+	return 0;
+}
+static void outq_pop(ws_client_t *c) {
+	ws_out_t *o = &c->out_q[c->out_head];
+	c->out_bytes -= o->f->len;
+	ws_frame_put(o->f);
+	c->out_head = (c->out_head + 1) % c->out_cap;
+	outq_stats(c);
+}
+/* Drop every queued frame and the ring itself */
+static void outq_clear(ws_client_t *c) {
+	while (c->out_head != c->out_tail)
+		outq_pop(c);
+	free(c->out_q);
+	c->out_q = NULL;
+	c->out_cap = c->out_head = c->out_tail = 0;
+	c->out_bytes = 0;
+	outq_stats(c);
+}
+
+/* ===================== permessage-deflate ===================== */
+/* RFC 7692 with context takeover: a client's deflater sees every message
+ * compressed for it, in send order, so repeated keys and names shrink to
+ * back-references. Messages under WS_DEFLATE_MIN go out plain (RSV1 clear)
+ * and touch neither context. */
+#define WS_PMD_ON         0x01
+#define WS_PMD_SERVER_NCT 0x02 /* server_no_context_takeover */
+#define WS_PMD_CLIENT_NCT 0x04 /* client_no_context_takeover */
+#define WS_PMD_TX_OFF     0x08 /* deflater failed: send plain from now on */
+#define WS_DEFLATE_MEMLEVEL 5
+
+static const unsigned char ws_deflate_tail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+static char* pmd_trim(char *s) {
+	while (*s == ' ' || *s == '\t')
+		s++;
+	char *e = s + strlen(s);
+	while (e > s && (e[-1] == ' ' || e[-1] == '\t'))
+		*--e = '\0';
+	return s;
+}
+/* Pick the first permessage-deflate offer in Sec-WebSocket-Extensions whose
+ * parameters we can honour and write the response header line to @p ext.
+ * Returns 1 when negotiated. */
+static int pmd_negotiate(ws_client_t *c, char *ext, size_t cap) {
+	char v[256];
+	if (!http_header_copy(c, "Sec-WebSocket-Extensions", v, sizeof(v)))
+		return 0;
+	char *so = NULL;
+	for (char *o = strtok_r(v, ",", &so); o; o = strtok_r(NULL, ",", &so)) {
+		char *sp = NULL;
+		char *p = strtok_r(o, ";", &sp);
+		if (!p || strcmp(pmd_trim(p), "permessage-deflate"))
+			continue;
+		int ok = 1, flags = WS_PMD_ON, sbits = WS_DEFLATE_WBITS, cbits = 0;
+		while (ok && (p = strtok_r(NULL, ";", &sp))) {
+			char *val = strchr(p, '=');
+			if (val) {
+				*val++ = '\0';
+				val = pmd_trim(val);
+				if (*val == '"' && strlen(val) > 1)
+					val[strlen(val) - 1] = '\0', val++;
+			}
+			p = pmd_trim(p);
+			int bits = val ? atoi(val) : 15;
+			if (!strcmp(p, "server_no_context_takeover") && !val) {
+				flags |= WS_PMD_SERVER_NCT;
+			} else if (!strcmp(p, "client_no_context_takeover") && !val) {
+				flags |= WS_PMD_CLIENT_NCT;
+			} else if (!strcmp(p, "server_max_window_bits") && val) {
+				if (bits < 9 || bits > 15) /* zlib has no raw 8-bit window */
+					ok = 0;
+				else if (bits < sbits)
+					sbits = bits;
+			} else if (!strcmp(p, "client_max_window_bits")) {
+				if (bits < 8 || bits > 15)
+					ok = 0;
+				else /* the client may shrink its window: ask for ours */
+					cbits = bits < WS_DEFLATE_WBITS ? bits : WS_DEFLATE_WBITS;
+			} else {
+				ok = 0;
+			}
+		}
+		if (!ok)
+			continue;
+		int n = snprintf(ext, cap, "Sec-WebSocket-Extensions: permessage-deflate"
+				"; server_max_window_bits=%d", sbits);
+		if (flags & WS_PMD_SERVER_NCT)
+			n += snprintf(ext + n, cap - (size_t) n, "; server_no_context_takeover");
+		if (flags & WS_PMD_CLIENT_NCT)
+			n += snprintf(ext + n, cap - (size_t) n, "; client_no_context_takeover");
+		if (cbits)
+			n += snprintf(ext + n, cap - (size_t) n, "; client_max_window_bits=%d",
+					cbits);
+		snprintf(ext + n, cap - (size_t) n, "\r\n");
+		c->pmd = (uint8_t) flags;
+		c->pmd_sbits = (uint8_t) sbits;
+		c->pmd_cbits = (uint8_t) (cbits ? cbits : 15);
+		return 1;
+	}
 	return 0;
 }
+static void pmd_release(ws_client_t *c) {
+	if (c->zd) {
+		deflateEnd(c->zd);
+		free(c->zd);
+		c->zd = NULL;
+	}
+	if (c->zi) {
+		inflateEnd(c->zi);
+		free(c->zi);
+		c->zi = NULL;
+	}
+	c->pmd = 0;
+}
+/* Compressed copy of data frame @p f for client @p c (RSV1 set, one more
+ * message in the deflate context), or NULL to send @p f as it is. */
+static ws_frame_t* pmd_deflate(ws_reactor_t *r, ws_client_t *c,
+		const ws_frame_t *f) {
+	size_t hlen = (f->buf[1] & 0x7F) == 127 ? 10 :
+					(f->buf[1] & 0x7F) == 126 ? 4 : 2;
+	size_t len = f->len - hlen;
+	if (len < WS_DEFLATE_MIN || (c->pmd & WS_PMD_TX_OFF))
+		return NULL;
+	if (!c->zd) {
+		c->zd = calloc(1, sizeof(*c->zd));
+		if (!c->zd || deflateInit2(c->zd, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				-(int) c->pmd_sbits, WS_DEFLATE_MEMLEVEL, Z_DEFAULT_STRATEGY)
+				!= Z_OK) {
+			free(c->zd);
+			c->zd = NULL;
+			c->pmd |= WS_PMD_TX_OFF;
+			return NULL;
+		}
+	}
+	size_t need = deflateBound(c->zd, len) + 16;
+	if (r->zcap < need) {
+		unsigned char *b = realloc(r->zbuf, need);
+		if (!b)
+			return NULL; /* not fed to the context: plain is still valid */
+		r->zbuf = b;
+		r->zcap = need;
+	}
+	c->zd->next_in = (Bytef*) (f->buf + hlen);
+	c->zd->avail_in = (uInt) len;
+	c->zd->next_out = r->zbuf;
+	c->zd->avail_out = (uInt) r->zcap;
+	int rc = deflate(c->zd, Z_SYNC_FLUSH);
+	size_t out = r->zcap - c->zd->avail_out;
+	if (rc != Z_OK || c->zd->avail_in || !c->zd->avail_out || out < 4) {
+		/* the context is unusable; messages not fed to it stay valid */
+		c->pmd |= WS_PMD_TX_OFF;
+		return NULL;
+	}
+	if (c->pmd & WS_PMD_SERVER_NCT)
+		deflateReset(c->zd);
+	/* the flush ends in 00 00 FF FF, which the peer appends back */
+	ws_frame_t *z = ws_frame_new((uint8_t) (0x40 | (f->buf[0] & 0x0F)),
+			r->zbuf, out - 4);
+	if (!z)
+		c->pmd |= WS_PMD_TX_OFF; /* the context holds a message never sent */
+	return z;
+}
+/* Inflate the @p len byte compressed message in @p in (room for 4 more bytes)
+ * into @p out. Returns the text length or -1. */
+static int pmd_inflate(ws_client_t *c, unsigned char *in, size_t len,
+		char *out, size_t outsz) {
+	if (!c->zi) {
+		c->zi = calloc(1, sizeof(*c->zi));
+		if (!c->zi || inflateInit2(c->zi, -(int) c->pmd_cbits) != Z_OK) {
+			free(c->zi);
+			c->zi = NULL;
+			return -1;
+		}
+	}
+	memcpy(in + len, ws_deflate_tail, sizeof(ws_deflate_tail));
+	c->zi->next_in = in;
+	c->zi->avail_in = (uInt) (len + sizeof(ws_deflate_tail));
+	c->zi->next_out = (Bytef*) out;
+	c->zi->avail_out = (uInt) (outsz - 1);
+	int rc = inflate(c->zi, Z_SYNC_FLUSH);
+	if ((rc != Z_OK && rc != Z_BUF_ERROR) || c->zi->avail_in)
+		return -1; /* corrupt, or larger than the buffer */
+	size_t n = outsz - 1 - c->zi->avail_out;
+	out[n] = '\0';
+	if (c->pmd & WS_PMD_CLIENT_NCT)
+		inflateReset(c->zi);
+	return (int) n;
+}
+
+#define WS_IOV_MAX 64 /* frames gathered per sendmsg() */
+
+/* Write the queued frames straight from the ring, up to WS_IOV_MAX of them
+ * per sendmsg(), resuming a frame cut short by the previous call. Returns 1
+ * once the ring is empty, 0 when the socket is full (wait for EPOLLOUT), -1
+ * on error. */
+static int outq_send(ws_client_t *c) {
+	while (c->out_head != c->out_tail) {
+		struct iovec iov[WS_IOV_MAX];
+		int n = 0;
+		for (int i = c->out_head; i != c->out_tail && n < WS_IOV_MAX;
+				i = (i + 1) % c->out_cap) {
+			iov[n].iov_base = c->out_q[i].f->buf + c->out_q[i].off;
+			iov[n].iov_len = c->out_q[i].f->len - c->out_q[i].off;
+			n++;
+		}
+		struct msghdr mh = { .msg_iov = iov, .msg_iovlen = (size_t) n };
+		ssize_t w = sendmsg(c->fd, &mh, MSG_NOSIGNAL);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		while (w > 0) {
+			ws_out_t *o = &c->out_q[c->out_head];
+			size_t left = o->f->len - o->off;
+			if ((size_t) w < left) { /* short write: the socket is full */
+				o->off += (uint32_t) w;
+				return 0;
+			}
+			w -= (ssize_t) left;
+			outq_pop(c);
+		}
+	}
+	return 1;
+}
+
+/* ===================== Pump-side helpers ===================== */
+static const size_t ws_pool_size[WS_POOL_CLASSES] = { WS_HTTP_HDR_MAX,
+		WS_RX_BUFSZ };
+
+/* Buffer of size class @p cls, from the idle list when possible */
+static void* pool_get(ws_reactor_t *r, int cls) {
+	void *b = r->pool.idle[cls];
+	if (!b)
+		return malloc(ws_pool_size[cls]);
+	r->pool.idle[cls] = *(void**) b;
+	r->pool.nidle[cls]--;
+	return b;
+}
+/* Return @p b; beyond WS_POOL_KEEP idle buffers it goes back to the heap */
+static void pool_put(ws_reactor_t *r, int cls, void *b) {
+	if (!b)
+		return;
+	if (r->pool.nidle[cls] >= WS_POOL_KEEP) {
+		free(b);
+		return;
+	}
+	*(void**) b = r->pool.idle[cls];
+	r->pool.idle[cls] = b;
+	r->pool.nidle[cls]++;
+}
+static void pool_flush(ws_reactor_t *r) {
+	for (int cls = 0; cls < WS_POOL_CLASSES; cls++) {
+		while (r->pool.nidle[cls]) {
+			void *b = pool_get(r, cls);
+			free(b);
+		}
+	}
+}
+
+/* Free slot in the partition of @p r */
+static int alloc_client(ws_reactor_t *r) {
+	ws_client_t *cs = r->ws->clients;
+	for (int i = r->first; i < r->first + r->count; i++)
+		if (cs[i].st == WS_CL_FREE) {
+			cs[i].fd = -1;
+			cs[i].st = WS_CL_HTTP;
+			cs[i].out_head = cs[i].out_tail = 0;
+			cs[i].out_armed = 0;
+			outq_stats_reset(&cs[i]);
+			cs[i].conn_id = 0;
+			cs[i].rx_len = 0;
+			memset(&cs[i].req, 0, sizeof(cs[i].req));
+			cs[i].keep_alive = 0;
+			cs[i].lingering = 0;
+			cs[i].rd_eof = 0;
+			cs[i].upgrading = 0;
+			cs[i].nreq = 0;
+			cs[i].hdr_len = cs[i].hdr_off = 0;
+			cs[i].http_tx = NULL;
+			cs[i].asset = NULL;
+			cs[i].http_len = cs[i].http_off = 0;
+			cs[i].file_fd = -1;
+			cs[i].pmd = 0;
+			cs[i].zd = cs[i].zi = NULL;
+			cs[i].binary = 0;
+			memset(&cs[i].rd, 0, sizeof(cs[i].rd));
+			cs[i].rd.hneed = 2;
+			return i;
+		}
+	return -1;
+}
 
-/* server->client pong frame (unmasked) */
-static int ws_send_pong(int fd, const unsigned char *p, size_t n) {
-	if (n > 125)
-		n = 125; /* control payload <= 125 */
-	unsigned char h[2] = { 0x8A, (unsigned char) n }; /* FIN=1, opcode=PONG(0xA) */
-	if (write(fd, h, 2) < 0)
+/* ===================== Static asset cache ===================== */
+/* A docroot file loaded once with its 200 and 304 headers pre-rendered up to
+ * the Connection line, which depends on the request, or a path found missing
+ * (answered 404 until a file appears there). The table holds one reference
+ * and every client sending from it another, so an entry invalidated mid-send
+ * lives until the last byte is written. The table is guarded by cache.mx,
+ * files are read with it released; refs are atomic since any reactor may
+ * drop the last one. */
+typedef struct ws_asset {
+	int refs;
+	uint8_t missing; /* no such file: no body, headers not rendered */
+	uint32_t key; /* FNV-1a of path */
+	char path[WS_DOCROOT_MAX + 512];
+	char etag[20]; /* quoted FNV-1a 64 of the body */
+	time_t mtime;
+	size_t head_len, head304_len;
+	char head[320]; /* 200 status line and headers */
+	char head304[192]; /* 304 status line and headers */
+	size_t len; /* body */
+	char data[];
+} ws_asset_t;
+
+static uint32_t fnv1a32(const char *s) {
+	uint32_t h = 2166136261u;
+	while (*s)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return h;
+}
+static uint64_t fnv1a64(const void *p, size_t n) {
+	const unsigned char *b = p;
+	uint64_t h = 14695981039346656037ULL;
+	while (n--)
+		h = (h ^ *b++) * 1099511628211ULL;
+	return h;
+}
+static void asset_get(ws_asset_t *a) {
+	__atomic_add_fetch(&a->refs, 1, __ATOMIC_RELAXED);
+}
+static void asset_put(ws_asset_t *a) {
+	if (a && __atomic_sub_fetch(&a->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(a);
+}
+static void asset_drop(ao_ws_t *me, int i) {
+	asset_put(me->cache.tab[i]);
+	me->cache.tab[i] = me->cache.tab[--me->cache.count];
+	me->cache.tab[me->cache.count] = NULL;
+}
+static void asset_flush(ao_ws_t *me) {
+	while (me->cache.count)
+		asset_drop(me, me->cache.count - 1);
+}
+static ws_asset_t* asset_lookup(ao_ws_t *me, const char *path) {
+	uint32_t key = fnv1a32(path);
+	for (int i = 0; i < me->cache.count; i++)
+		if (me->cache.tab[i]->key == key && !strcmp(me->cache.tab[i]->path, path))
+			return me->cache.tab[i];
+	return NULL;
+}
+/* Watch the directory holding @p path so edits invalidate its entries */
+static int asset_watch(ao_ws_t *me, const char *path) {
+	const char *slash = strrchr(path, '/');
+	size_t dlen = slash ? (size_t) (slash - path) : 0;
+	char dir[sizeof(me->cache.dirs[0].dir)];
+	memcpy(dir, path, dlen);
+	dir[dlen] = '\0';
+	for (int i = 0; i < me->cache.ndirs; i++)
+		if (!strcmp(me->cache.dirs[i].dir, dir))
+			return 0;
+	if (me->cache.ndirs >= WS_ASSET_MAX)
 		return -1;
-	if (n && write(fd, p, n) < 0)
+	int wd = inotify_add_watch(me->cache.ifd, dlen ? dir : "/",
+			IN_CREATE | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM
+					| IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (wd < 0)
 		return -1;
+	me->cache.dirs[me->cache.ndirs].wd = wd;
+	strcpy(me->cache.dirs[me->cache.ndirs].dir, dir);
+	me->cache.ndirs++;
 	return 0;
 }
+/* Allocate an entry with room for a @p len byte body; asset_seal() it once
+ * the body is filled in. */
+static ws_asset_t* asset_alloc(const char *path, size_t len) {
+	if (strlen(path) >= sizeof(((ws_asset_t*) 0)->path))
+		return NULL;
+	ws_asset_t *a = malloc(sizeof(*a) + len);
+	if (!a)
+		return NULL;
+	a->refs = 1;
+	a->missing = 0;
+	a->key = fnv1a32(path);
+	strcpy(a->path, path);
+	a->len = len;
+	return a;
+}
+/* Hash the body into the ETag and pre-render the 200 and 304 headers */
+static void asset_seal(ws_asset_t *a, time_t mtime) {
+	char lastmod[64];
+	struct tm tm;
+	gmtime_r(&mtime, &tm);
+	strftime(lastmod, sizeof(lastmod), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	a->mtime = mtime;
+	snprintf(a->etag, sizeof(a->etag), "\"%016llx\"",
+			(unsigned long long) fnv1a64(a->data, a->len));
+	a->head_len = (size_t) snprintf(a->head, sizeof(a->head),
+			"HTTP/1.1 200 OK\r\n"
+					"Content-Type: %s\r\n"
+					"Content-Length: %zu\r\n"
+					"ETag: %s\r\n"
+					"Last-Modified: %s\r\n"
+					"Cache-Control: no-cache\r\n", mime_from_ext(a->path),
+			a->len, a->etag, lastmod);
+	a->head304_len = (size_t) snprintf(a->head304, sizeof(a->head304),
+			"HTTP/1.1 304 Not Modified\r\n"
+					"ETag: %s\r\n"
+					"Last-Modified: %s\r\n"
+					"Cache-Control: no-cache\r\n", a->etag, lastmod);
+}
+/* Read @p path into a new, sealed entry; called without cache.mx. NULL with
+ * *missing set when there is no such file, NULL alone when it is not regular,
+ * larger than WS_ASSET_MAX_SIZE or unreadable. */
+static ws_asset_t* asset_read(const char *path, int *missing) {
+	*missing = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		*missing = errno == ENOENT || errno == ENOTDIR;
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+			|| (size_t) st.st_size > WS_ASSET_MAX_SIZE) {
+		close(fd);
+		return NULL;
+	}
+	size_t fsz = (size_t) st.st_size;
+	ws_asset_t *a = asset_alloc(path, fsz);
+	if (!a) {
+		close(fd);
+		return NULL;
+	}
+	size_t got = 0;
+	while (got < fsz) {
+		ssize_t r = read(fd, a->data + got, fsz - got);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		got += (size_t) r;
+	}
+	close(fd);
+	if (got != fsz) {
+		free(a);
+		return NULL;
+	}
+	asset_seal(a, st.st_mtime);
+	return a;
+}
+/* Index of the entry to evict for a file when the table is full (a miss:
+ * files are worth more), -1 when there is none */
+static int asset_victim(const ao_ws_t *me) {
+	for (int i = 0; i < me->cache.count; i++)
+		if (me->cache.tab[i]->missing)
+			return i;
+	return -1;
+}
+/* Enter @p a into the table, which takes over the caller's reference: 0, or
+ * -1 when there is no room. Under cache.mx. */
+static int asset_insert(ao_ws_t *me, ws_asset_t *a) {
+	if (me->cache.count >= WS_ASSET_MAX) {
+		int i = a->missing ? -1 : asset_victim(me);
+		if (i < 0)
+			return -1;
+		asset_drop(me, i);
+	}
+	me->cache.tab[me->cache.count++] = a;
+	return 0;
+}
+/* Reference to the cache entry for @p path, loading it on a miss; NULL when
+ * the file cannot be cached and is to be served from disk. The file is read
+ * with cache.mx released, so a large asset does not hold up the other
+ * reactors, and entered only if no invalidation ran meanwhile; otherwise the
+ * caller gets the only reference. */
+static ws_asset_t* asset_acquire(ao_ws_t *me, const char *path) {
+	pthread_mutex_lock(&me->cache.mx);
+	ws_asset_t *a = asset_lookup(me, path);
+	if (a)
+		asset_get(a);
+	/* watch first so a write racing the read still invalidates the entry */
+	int load = !a && me->cache.ifd >= 0
+			&& (me->cache.count < WS_ASSET_MAX || asset_victim(me) >= 0)
+			&& asset_watch(me, path) == 0;
+	uint32_t gen = me->cache.gen;
+	pthread_mutex_unlock(&me->cache.mx);
+	if (!load)
+		return a;
+
+	int missing;
+	a = asset_read(path, &missing);
+	if (!a && missing && (a = asset_alloc(path, 0)) != NULL)
+		a->missing = 1;
+	if (!a)
+		return NULL;
 
-/* Read a single incoming client frame; handle control frames.
- * Returns:
- *   >0  : length of text copied into 'out' (NUL-terminated)
- *    0  : control frame handled (ping/pong/close) — keep connection
- *   -2  : EAGAIN / would block (no data right now)
- *   -1  : error / peer closed / protocol error — close socket
- */
-static int ws_read_text(int fd, char *out, size_t outsz) {
-	unsigned char h[2];
-	ssize_t n = read(fd, h, 2);
-	if (n == 0)
-		return -1; /* peer closed */
-	if (n < 0) {
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
-			return -2;
-		return -1;
+	pthread_mutex_lock(&me->cache.mx);
+	ws_asset_t *cur = asset_lookup(me, path);
+	if (cur) {
+		/* another reactor loaded it first */
+		asset_get(cur);
+		pthread_mutex_unlock(&me->cache.mx);
+		asset_put(a);
+		return cur;
 	}
-	if (n != 2)
-		return -1;
+	if (me->cache.gen == gen && asset_insert(me, a) == 0)
+		asset_get(a);
+	pthread_mutex_unlock(&me->cache.mx);
+	return a;
+}
+/* True when the request's validators match @p a (If-None-Match wins) */
+static int asset_not_modified(const ws_asset_t *a, const ws_client_t *c) {
+	char v[256];
+	size_t n;
+	const char *inm = http_header(c, "If-None-Match", &n);
+	if (inm)
+		return hp_has_token(inm, n, a->etag) || (n == 1 && *inm == '*');
+	if (http_header_copy(c, "If-Modified-Since", v, sizeof(v))) {
+		struct tm tm = { 0 };
+		if (!strptime(v, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+			return 0;
+		return a->mtime <= timegm(&tm);
+	}
+	return 0;
+}
+/* Drain inotify and drop every cached file that changed */
+static void asset_handle_inotify(ao_ws_t *me) {
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t n;
+	while ((n = read(me->cache.ifd, buf, sizeof(buf))) > 0) {
+		pthread_mutex_lock(&me->cache.mx);
+		me->cache.gen++; /* loads in flight must not enter stale data */
+		for (char *p = buf; p < buf + n;) {
+			const struct inotify_event *ev = (const struct inotify_event*) p;
+			p += sizeof(*ev) + ev->len;
+			if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				asset_flush(me);
+				continue;
+			}
+			if (!ev->len)
+				continue;
+			for (int d = 0; d < me->cache.ndirs; d++) {
+				if (me->cache.dirs[d].wd != ev->wd)
+					continue;
+				char path[sizeof(me->cache.dirs[0].dir) + NAME_MAX + 2];
+				snprintf(path, sizeof(path), "%s/%s", me->cache.dirs[d].dir,
+						ev->name);
+				for (int i = 0; i < me->cache.count; i++)
+					if (!strcmp(me->cache.tab[i]->path, path)) {
+						asset_drop(me, i);
+						break;
+					}
+				break;
+			}
+		}
+		pthread_mutex_unlock(&me->cache.mx);
+	}
+}
 
-	int fin = (h[0] & 0x80) != 0;
-	int opcode = h[0] & 0x0F;
-	int masked = (h[1] & 0x80) != 0;
-	uint64_t len = (uint64_t) (h[1] & 0x7F);
+/* ===================== Live JSON documents ===================== */
+/* Dashboard endpoints answered from the in-memory snapshot instead of the
+ * docroot. Each render becomes a ws_asset_t, so polls get the same ETag/304
+ * handling as files, and a document is re-rendered only after an update. */
+typedef struct ws_route {
+	const char *path;
+	uint8_t doc; /* ws_doc_t */
+	ws_asset_t* (*render)(ao_ws_t *me, const struct ws_route *r,
+			const ws_client_t *c);
+} ws_route_t;
+
+/* Records of @p r->doc joined into a JSON array, "{}" for unpublished slots */
+static ws_asset_t* live_render_array(ao_ws_t *me, const ws_route_t *r,
+		const ws_client_t *c) {
+	(void) c;
+	const ws_live_doc_t *d = &me->live.doc[r->doc];
+	size_t len = 2;
+	for (int i = 0; i < d->nrec; i++)
+		len += (d->len[i] ? d->len[i] : 2) + (i > 0);
+	ws_asset_t *a = asset_alloc(r->path, len);
+	if (!a)
+		return NULL;
+	char *p = a->data;
+	*p++ = '[';
+	for (int i = 0; i < d->nrec; i++) {
+		if (i > 0)
+			*p++ = ',';
+		if (d->len[i]) {
+			memcpy(p, d->rec[i], d->len[i]);
+			p += d->len[i];
+		} else {
+			memcpy(p, "{}", 2);
+			p += 2;
+		}
+	}
+	*p = ']';
+	asset_seal(a, d->mtime);
+	return a;
+}
+/* Record 0 of @p r->doc as a single JSON object */
+static ws_asset_t* live_render_object(ao_ws_t *me, const ws_route_t *r,
+		const ws_client_t *c) {
+	(void) c;
+	const ws_live_doc_t *d = &me->live.doc[r->doc];
+	ws_asset_t *a = asset_alloc(r->path, d->len[0] ? d->len[0] : 2);
+	if (!a)
+		return NULL;
+	memcpy(a->data, d->len[0] ? d->rec[0] : "{}", a->len);
+	asset_seal(a, d->mtime);
+	return a;
+}
+/* Address of the peer of @p c as 16 bytes, IPv4 mapped into IPv6; zero when
+ * unknown */
+static void ws_peer_addr(const ws_client_t *c, uint8_t addr[16]) {
+	struct sockaddr_storage ss;
+	socklen_t sl = sizeof(ss);
+	memset(addr, 0, 16);
+	if (getpeername(c->fd, (struct sockaddr*) &ss, &sl) < 0)
+		return;
+	if (ss.ss_family == AF_INET6) {
+		memcpy(addr, &((const struct sockaddr_in6*) &ss)->sin6_addr, 16);
+	} else if (ss.ss_family == AF_INET) {
+		addr[10] = addr[11] = 0xFF;
+		memcpy(addr + 12, &((const struct sockaddr_in*) &ss)->sin_addr, 4);
+	}
+}
+/* loghead.json rewinds the log cursor and lognext.json advances it, one record
+ * per request; {"level":255} marks the end. Each peer address has its own
+ * cursor, as its requests may come over several connections; the least
+ * recently used one is recycled for a new peer. */
+static ws_asset_t* live_render_log(ao_ws_t *me, const ws_route_t *r,
+		const ws_client_t *c) {
+	ws_live_log_t *l = &me->live.log;
+	static const char end[] = "{\"level\":255}";
+	uint8_t peer[16];
+	ws_peer_addr(c, peer);
+	ws_log_reader_t *rd = &l->reader[0];
+	for (int i = 0; i < WS_LIVE_LOG_READERS; i++) {
+		ws_log_reader_t *o = &l->reader[i];
+		if (o->used && !memcmp(o->addr, peer, sizeof(peer))) {
+			rd = o;
+			break;
+		}
+		if (o->used < rd->used)
+			rd = o;
+	}
+	if (!rd->used || memcmp(rd->addr, peer, sizeof(peer))) {
+		memcpy(rd->addr, peer, sizeof(peer));
+		rd->next = l->seq;
+	}
+	if (++l->requests == 0) /* 0 marks a free reader */
+		l->requests = 1;
+	rd->used = l->requests;
+	/* rewound, or its next record has been dropped since */
+	if (!strcmp(r->path, "/loghead.json") || (int32_t) (rd->next - l->seq) < 0)
+		rd->next = l->seq;
+	const char *rec = end;
+	size_t len = sizeof(end) - 1;
+	if (rd->next - l->seq < l->count) {
+		uint16_t i = (uint16_t) ((l->head + (rd->next++ - l->seq))
+				% WS_LIVE_LOG_LEN);
+		rec = l->rec[i];
+		len = l->len[i];
+	}
+	ws_asset_t *a = asset_alloc(r->path, len);
+	if (!a)
+		return NULL;
+	memcpy(a->data, rec, len);
+	asset_seal(a, time(NULL));
+	return a;
+}
 
-	if (!masked)
-		return -1; /* clients must mask */
-	if ((h[0] & 0x70) != 0)
-		return -1; /* RSV not supported */
+static const ws_route_t ws_routes[] = {
+	{ "/module_control.json", WS_DOC_MODULE_CONTROL, live_render_array },
+	{ "/module_monitoring.json", WS_DOC_MODULE_MONITORING, live_render_array },
+	{ "/module_info.json", WS_DOC_MODULE_INFO, live_render_array },
+	{ "/sidebar.json", WS_DOC_SIDEBAR, live_render_array },
+	{ "/summary.json", WS_DOC_SUMMARY, live_render_array },
+	{ "/settings.json", WS_DOC_SETTINGS, live_render_object },
+	{ "/loghead.json", WS_DOC_LOG, live_render_log },
+	{ "/lognext.json", WS_DOC_LOG, live_render_log },
+};
+
+/* Topic names used by WS_LIVE_SUBSCRIBE and in pushed frames, by ws_doc_t */
+static const char *const ws_doc_names[WS_DOC_COUNT] = { "module_control",
+		"module_monitoring", "module_info", "sidebar", "summary", "settings",
+		"log" };
+
+/* Referenced body for @p path when it is a live route with data, else NULL
+ * (documents never published fall through to the docroot). Reactor thread. */
+static ws_asset_t* live_get(ao_ws_t *me, const ws_client_t *c,
+		const char *path) {
+	const ws_route_t *r = NULL;
+	for (size_t i = 0; i < sizeof(ws_routes) / sizeof(ws_routes[0]); i++)
+		if (!strcmp(ws_routes[i].path, path)) {
+			r = &ws_routes[i];
+			break;
+		}
+	if (!r)
+		return NULL;
 
-	if (len == 126) {
-		unsigned char e[2];
-		if (read(fd, e, 2) != 2)
-			return -1;
-		len = ((uint64_t) e[0] << 8) | e[1];
-	} else if (len == 127) {
-		unsigned char e[8];
-		if (read(fd, e, 8) != 8)
-			return -1;
-		uint64_t L = 0;
-		for (int i = 0; i < 8; i++)
-			L = (L << 8) | e[i];
-		if (L >> 63)
-			return -1; /* reject absurdly large */
-		len = L;
+	ws_asset_t *a = NULL;
+	pthread_mutex_lock(&me->live.mx);
+	if (r->doc == WS_DOC_LOG) {
+		if (me->live.log.count)
+			a = r->render(me, r, c); /* moves the cursor: never cached */
+	} else if (me->live.doc[r->doc].version) {
+		a = me->live.body[r->doc];
+		if (!a || me->live.rendered[r->doc] != me->live.doc[r->doc].version) {
+			ws_asset_t *fresh = r->render(me, r, c);
+			if (fresh) {
+				asset_put(a);
+				me->live.body[r->doc] = a = fresh;
+				me->live.rendered[r->doc] = me->live.doc[r->doc].version;
+			}
+		}
+		if (a)
+			asset_get(a);
 	}
+	pthread_mutex_unlock(&me->live.mx);
+	return a;
+}
 
-	unsigned char mask[4];
-	if (read(fd, mask, 4) != 4)
-		return -1;
+/* Frame for record @p slot of @p doc, of the form
+ * {"type":"live","doc":"name","slot":n,"data":record}. A newer record for the
+ * same slot may replace it while it is queued; log records never do. */
+static ws_frame_t* live_frame(uint8_t doc, uint8_t slot, const char *rec,
+		size_t len) {
+	char m[WS_TX_BUFSZ];
+	int n = snprintf(m, sizeof(m),
+			"{\"type\":\"live\",\"doc\":\"%s\",\"slot\":%u,\"data\":%.*s}",
+			ws_doc_names[doc], (unsigned) slot, (int) len, rec);
+	if (n <= 0 || n >= (int) sizeof(m))
+		return NULL;
+	ws_frame_t *f = ws_frame_new(0x1, m, (size_t) n);
+	if (f) {
+		f->cls = WS_MSG_LIVE;
+		f->key = doc == WS_DOC_LOG ? 0 : 1u + ((unsigned) doc << 4 | slot);
+	}
+	return f;
+}
 
-	/* Control frames: opcode 0x8(close), 0x9(ping), 0xA(pong) */
-	if (opcode & 0x08) {
-		if (!fin || len > 125)
-			return -1; /* control must be FIN=1 and <=125 */
-		unsigned char tmp[125];
-		size_t got = 0;
-		while (got < len) {
-			ssize_t r = read(fd, tmp + got, (size_t) len - got);
-			if (r <= 0)
-				return -1;
-			got += (size_t) r;
+/* Replace the subscriptions of client @p idx with the WS_LIVE_SUBSCRIBE topic
+ * list @p topics, then send it the current record of every topic it now
+ * follows so the page renders without a first poll. AO thread. */
+static void ws_live_subscribe(ao_ws_t *me, int idx, const char *topics) {
+	uint16_t *sub = me->live.sub[idx];
+	memset(sub, 0, sizeof(me->live.sub[idx]));
+
+	for (const char *p = topics; *p;) {
+		size_t n = strcspn(p, ",:");
+		int doc = -1;
+		for (int i = 0; i < WS_DOC_COUNT; i++)
+			if (strlen(ws_doc_names[i]) == n && !strncmp(p, ws_doc_names[i], n)) {
+				doc = i;
+				break;
+			}
+		p += n;
+		uint16_t mask = 0xFFFF;
+		if (*p == ':') {
+			char *end;
+			unsigned long slot = strtoul(p + 1, &end, 10);
+			mask = (end > p + 1 && slot < WS_LIVE_SLOTS) ?
+					(uint16_t) (1u << slot) : 0;
+			p = end + strcspn(end, ",");
 		}
-		for (size_t i = 0; i < len; i++)
-			tmp[i] ^= mask[i & 3]; /* unmask */
+		if (doc >= 0)
+			sub[doc] |= mask;
+		if (*p == ',')
+			p++;
+	}
 
-		if (opcode == 0x9) { /* ping -> pong same payload */
-			(void) ws_send_pong(fd, tmp, (size_t) len);
-			return 0;
-		} else if (opcode == 0xA) {
-			return 0; /* ignore pong */
-		} else if (opcode == 0x8) {
-			return -1; /* close: caller should drop TCP */
+	/* the AO thread is the only writer of the records: no lock to read them */
+	for (uint8_t d = 0; d < WS_DOC_COUNT; d++) {
+		if (d == WS_DOC_LOG)
+			continue; /* history comes from loghead/lognext */
+		const ws_live_doc_t *doc = &me->live.doc[d];
+		for (uint8_t s = 0; s < doc->nrec; s++) {
+			if (!(sub[d] & (1u << s)) || !doc->len[s])
+				continue;
+			ws_frame_t *f = live_frame(d, s, doc->rec[s], doc->len[s]);
+			if (f)
+				ws_cmd_queue(ws_reactor(me, idx), idx, f);
+		}
+	}
+}
+
+/* Store a WS_LIVE_UPDATE record. AO thread. */
+static void ws_live_update(ao_ws_t *me, const message_frame_t *ev) {
+	uint8_t doc = (uint8_t) ((ev->signal >> 4) & 0xF);
+	uint8_t slot = (uint8_t) (ev->signal & 0xF);
+	const char *txt = ev->ptr ? (const char*) ev->ptr : (const char*) ev->payload;
+	size_t len = ev->ptr ? ev->length : strnlen(txt,
+			ev->length < sizeof(ev->payload) ? ev->length : sizeof(ev->payload));
+
+	if (doc < WS_DOC_COUNT && len > 0 && len <= WS_LIVE_REC_MAX
+			&& (doc == WS_DOC_LOG || slot < WS_LIVE_SLOTS)) {
+		pthread_mutex_lock(&me->live.mx);
+		if (doc == WS_DOC_LOG) {
+			ws_live_log_t *l = &me->live.log;
+			uint16_t i = (uint16_t) ((l->head + l->count) % WS_LIVE_LOG_LEN);
+			if (l->count == WS_LIVE_LOG_LEN) { /* full: drop the oldest */
+				l->head = (uint16_t) ((l->head + 1) % WS_LIVE_LOG_LEN);
+				l->seq++;
+			} else {
+				l->count++;
+			}
+			memcpy(l->rec[i], txt, len);
+			l->len[i] = (uint16_t) len;
+		} else {
+			ws_live_doc_t *d = &me->live.doc[doc];
+			memcpy(d->rec[slot], txt, len);
+			d->len[slot] = (uint16_t) len;
+			if (slot >= d->nrec)
+				d->nrec = (uint8_t) (slot + 1);
+			d->mtime = time(NULL);
+			d->version++;
+		}
+		pthread_mutex_unlock(&me->live.mx);
+
+		/* push the record to the clients following it: encoded once, one
+		 * command per reactor serving any of them */
+		ws_frame_t *f = NULL;
+		for (int i = 0; i < WS_MAX_CLIENTS; i++)
+			if (doc == WS_DOC_LOG ?
+					me->live.sub[i][doc] != 0 : (me->live.sub[i][doc] & (1u << slot))) {
+				if (!f && !(f = live_frame(doc, slot, txt, len)))
+					break;
+				ws_frame_to_set(f, i);
+			}
+		if (f)
+			ws_cmd_push_to(me, f);
+	}
+	free(ev->ptr);
+}
+static void live_flush(ao_ws_t *me) {
+	for (int i = 0; i < WS_DOC_COUNT; i++) {
+		asset_put(me->live.body[i]);
+		me->live.body[i] = NULL;
+		me->live.rendered[i] = 0;
+	}
+}
+
+static void free_http_buf(ws_reactor_t *r, ws_client_t *c) {
+	pool_put(r, WS_POOL_HDR, c->http_hdr);
+	c->http_hdr = NULL;
+	if (c->asset) {
+		asset_put(c->asset);
+		c->asset = NULL;
+	}
+	c->hdr_len = c->hdr_off = 0;
+	c->http_tx = NULL;
+	c->http_len = c->http_off = 0;
+	if (c->file_fd >= 0) {
+		close(c->file_fd);
+		c->file_fd = -1;
+	}
+}
+/* Give back everything a connection holds besides its socket */
+static void client_release(ws_reactor_t *r, ws_client_t *c) {
+	free_http_buf(r, c);
+	outq_clear(c);
+	pmd_release(c);
+	pool_put(r, WS_POOL_RX, c->rd.msg);
+	c->rd.msg = NULL;
+	c->rd.msg_len = 0;
+	pool_put(r, WS_POOL_RX, c->rx);
+	c->rx = NULL;
+	c->rx_len = 0;
+}
+static void free_client(ao_ws_t *me, int idx) {
+	if (idx < 0)
+		return;
+	ws_reactor_t *r = ws_reactor(me, idx);
+	client_release(r, &me->clients[idx]);
+	if (me->clients[idx].fd >= 0) {
+		ep_del(r->epfd, me->clients[idx].fd);
+		close(me->clients[idx].fd);
+	}
+	me->clients[idx].fd = -1;
+	me->clients[idx].st = WS_CL_FREE;
+	me->clients[idx].gen++; /* invalidates events still queued for the slot */
+}
+/* Close the response header: Connection line(s) and the blank line */
+static size_t http_end_head(const ws_client_t *c, char *p, size_t cap) {
+	int n = c->keep_alive ?
+			snprintf(p, cap, "Connection: keep-alive\r\n"
+					"Keep-Alive: timeout=%d, max=%d\r\n\r\n",
+			WS_HTTP_IDLE_MS / 1000, WS_HTTP_MAX_REQS - c->nreq) :
+			snprintf(p, cap, "Connection: close\r\n\r\n");
+	return (size_t) n;
+}
+/* HTTP/1.1 persists unless the client says close; HTTP/1.0 only on request */
+static int http_wants_keep_alive(const ws_client_t *c) {
+	size_t n;
+	const char *v = http_header(c, "Connection", &n);
+	if (v && hp_has_token(v, n, "close"))
+		return 0;
+	if (v && hp_has_token(v, n, "keep-alive"))
+		return 1;
+	return c->req.minor >= 1;
+}
+/* Whole response (status page) in the header buffer */
+static void http_status_response(ws_client_t *c, int code, const char *reason) {
+	char body[96];
+	int blen = snprintf(body, sizeof(body), "<h1>%d %s</h1>", code, reason);
+	int hlen = snprintf(c->http_hdr, WS_HTTP_HDR_MAX, "HTTP/1.1 %d %s\r\n"
+			"Content-Type: text/html; charset=utf-8\r\n"
+			"Content-Length: %d\r\n", code, reason, blen);
+	hlen += (int) http_end_head(c, c->http_hdr + hlen,
+			WS_HTTP_HDR_MAX - (size_t) hlen);
+	memcpy(c->http_hdr + hlen, body, (size_t) blen);
+	c->hdr_len = (size_t) (hlen + blen);
+}
+
+/* Build an HTTP response for a static file: header, then the body from the
+ * cache (http_tx) or the file (file_fd). */
+static int http_prepare_file_response(ao_ws_t *me, ws_client_t *c) {
+	char path[512];
+	size_t plen = c->req.target.len < sizeof(path) ? c->req.target.len :
+			sizeof(path) - 1;
+	memcpy(path, c->rx + c->req.target.off, plen);
+	path[plen] = '\0';
+	sanitize_path(path);
+
+	char full[WS_DOCROOT_MAX + 512];
+	if (strcmp(path, "/") == 0) {
+		snprintf(full, sizeof(full), "%s/index.html", me->docroot);
+	} else {
+		const char *p = (path[0] == '/') ? path + 1 : path;
+		snprintf(full, sizeof(full), "%s/%s", me->docroot, p);
+	}
+
+	/* live document or cached file: no disk I/O, 304 when the validators
+	 * match */
+	ws_asset_t *a = live_get(me, c, path);
+	if (!a)
+		a = asset_acquire(me, full);
+	if (a && a->missing) {
+		asset_put(a);
+		http_status_response(c, 404, "Not Found");
+		return 0;
+	}
+	if (a) {
+		c->asset = a;
+		if (asset_not_modified(a, c)) {
+			memcpy(c->http_hdr, a->head304, a->head304_len);
+			c->hdr_len = a->head304_len;
+		} else {
+			memcpy(c->http_hdr, a->head, a->head_len);
+			c->hdr_len = a->head_len;
+			c->http_tx = a->data;
+			c->http_len = a->len;
 		}
+		c->hdr_len += http_end_head(c, c->http_hdr + c->hdr_len,
+				WS_HTTP_HDR_MAX - c->hdr_len);
+		return 0;
+	}
+
+	int fd = open(full, O_RDONLY);
+	if (fd < 0) {
+		http_status_response(c, 404, "Not Found");
 		return 0;
 	}
 
-	/* Data frames: accept text(0x1) and continuation(0x0) only (simplified) */
-	if (opcode != 0x1 && opcode != 0x0)
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
 		return -1;
-	if (len >= outsz)
-		len = outsz - 1;
+	}
 
-	size_t got = 0;
-	while (got < len) {
-		ssize_t r = read(fd, (unsigned char*) out + got, (size_t) len - got);
-		if (r <= 0)
-			return -1;
-		got += (size_t) r;
+	/* only the header lives in user space; the body goes out by sendfile() */
+	int hlen = snprintf(c->http_hdr, WS_HTTP_HDR_MAX, "HTTP/1.1 200 OK\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %lld\r\n", mime_from_ext(full),
+			(long long) st.st_size);
+	c->hdr_len = (size_t) hlen
+			+ http_end_head(c, c->http_hdr + hlen,
+					WS_HTTP_HDR_MAX - (size_t) hlen);
+	c->file_fd = fd;
+	c->file_off = 0;
+	c->file_end = st.st_size;
+	return 0;
+}
+
+/* Push the pending response: 1 when complete, 0 when the socket is full
+ * (resume on EPOLLOUT), -1 on error. */
+static int http_send_part(int fd, const char *p, size_t len, size_t *off,
+		int more) {
+	while (*off < len) {
+		/* MSG_MORE lets a part share a segment with the next one */
+		ssize_t w = send(fd, p + *off, len - *off,
+				MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+		if (w > 0) {
+			*off += (size_t) w;
+			continue;
+		}
+		if (w < 0 && errno == EINTR)
+			continue;
+		return (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 0 : -1;
 	}
-	for (size_t i = 0; i < len; i++)
-		out[i] = out[i] ^ mask[i & 3];
-	out[len] = '\0';
+	return 1;
+}
+static int http_send_pending(ws_client_t *c) {
+	int rc = http_send_part(c->fd, c->http_hdr, c->hdr_len, &c->hdr_off,
+			c->http_len > 0 || c->file_fd >= 0);
+	if (rc <= 0)
+		return rc;
+	if (c->http_tx) {
+		rc = http_send_part(c->fd, c->http_tx, c->http_len, &c->http_off,
+				c->file_fd >= 0);
+		if (rc <= 0)
+			return rc;
+	}
+	while (c->file_fd >= 0 && c->file_off < c->file_end) {
+		ssize_t w = sendfile(c->fd, c->file_fd, &c->file_off,
+				(size_t) (c->file_end - c->file_off));
+		if (w > 0)
+			continue;
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		return -1; /* error, or the file shrank under us */
+	}
+	return 1;
+}
 
-	/* We don’t reassemble multi-frame messages here; typical browsers send small complete frames */
-	(void) fin;
-	return (int) len;
+/* Answer a WebSocket upgrade request; the connection leaves HTTP for good */
+static int http_upgrade(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	char key[128];
+	if (!http_header_copy(c, "Sec-WebSocket-Key", key, sizeof(key)))
+		return -1;
+	char ext[160] = "";
+	(void) pmd_negotiate(c, ext, sizeof(ext));
+	size_t n;
+	const char *proto = http_header(c, "Sec-WebSocket-Protocol", &n);
+	c->binary = proto && hp_has_token(proto, n, WS_SUBPROTOCOL);
+	char *accept = ws_accept_from_key(key);
+	if (!accept)
+		return -1;
+	int n2 = snprintf(c->http_hdr, WS_HTTP_HDR_MAX,
+			"HTTP/1.1 101 Switching Protocols\r\n"
+					"Upgrade: websocket\r\n"
+					"Connection: Upgrade\r\n"
+					"Sec-WebSocket-Accept: %s\r\n%s%s\r\n", accept,
+			c->binary ? "Sec-WebSocket-Protocol: " WS_SUBPROTOCOL "\r\n" : "",
+			ext);
+	free(accept);
+	if (n2 < 0 || n2 >= WS_HTTP_HDR_MAX)
+		return -1;
+
+	/* the 101 goes out like any response; frames sent right behind the
+	 * request wait in rx until it is gone */
+	c->hdr_len = (size_t) n2;
+	c->upgrading = 1;
+	c->rx_len -= c->req.line;
+	memmove(c->rx, c->rx + c->req.line, c->rx_len);
+	memset(&c->req, 0, sizeof(c->req));
+	int rc = http_send_pending(c);
+	if (rc < 0)
+		return -1;
+	if (rc > 0)
+		return ws_upgraded(me, idx);
+	ep_mod(ws_reactor(me, idx)->epfd, c->fd, EPOLLOUT | EPOLLERR,
+			ws_tag(me, idx));
+	return 0;
 }
 
-/* ===================== Pump-side helpers ===================== */
-static int alloc_client(ws_client_t *cs) {
-	for (int i = 0; i < WS_MAX_CLIENTS; i++)
-		if (cs[i].st == WS_CL_FREE) {
-			cs[i].fd = -1;
-			cs[i].st = WS_CL_HTTP;
-			cs[i].out_head = cs[i].out_tail = 0;
-			cs[i].conn_id = 0;
-			cs[i].http_tx = NULL;
-			cs[i].http_len = cs[i].http_off = 0;
-			return i;
+/* The 101 is fully sent: the connection speaks WebSocket from here on.
+ * Frames that came behind the request go to the frame decoder, which takes
+ * the rest straight off the socket. Returns -1 once the client is dropped. */
+static int ws_upgraded(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	ws_reactor_t *r = ws_reactor(me, idx);
+	free_http_buf(r, c);
+	c->upgrading = 0;
+	c->st = WS_CL_WS;
+	message_frame_t e = { 0 };
+	e.signal = WS_EVT_WS_OPEN;
+	e.length = sizeof(int);
+	memcpy(e.payload, &idx, sizeof(int));
+	ws_pump_post(me, &e);
+
+	int rc = c->rx_len ? ws_rd_feed(me, idx, (const uint8_t*) c->rx, c->rx_len) : 0;
+	c->rx_len = 0;
+	pool_put(r, WS_POOL_RX, c->rx);
+	c->rx = NULL;
+	if (rc < 0) {
+		ws_client_lost(me, idx);
+		return -1;
+	}
+	c->out_armed = 0;
+	ep_mod(r->epfd, c->fd, EPOLLIN | EPOLLRDHUP | EPOLLERR, ws_tag(me, idx));
+	/* a ping among those frames may have queued a pong */
+	if (c->out_head != c->out_tail)
+		return ws_flush(me, idx);
+	return 0;
+}
+
+/* Settle a send result (see http_send_pending): release a finished response
+ * and close unless keep-alive. After an error response the write side is shut
+ * and input is drained until the peer closes, so the error is not lost to a
+ * reset. Returns -1 once the client is freed, else the send result. */
+static int http_done(ao_ws_t *me, int idx, int rc) {
+	ws_client_t *c = &me->clients[idx];
+	if (rc < 0 || (rc > 0 && !c->keep_alive && !c->lingering)) {
+		free_client(me, idx);
+		return -1;
+	}
+	if (rc > 0) {
+		free_http_buf(ws_reactor(me, idx), c);
+		if (c->lingering) {
+			shutdown(c->fd, SHUT_WR);
+			ep_mod(ws_reactor(me, idx)->epfd, c->fd, EPOLLIN | EPOLLRDHUP | EPOLLERR,
+					ws_tag(me, idx));
+		}
+	}
+	return rc;
+}
+
+/* Serve buffered requests in order, one response in flight at a time, until
+ * the buffer runs dry or the socket fills. Returns -1 once the client is
+ * freed. */
+static int http_serve(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	ws_reactor_t *r = ws_reactor(me, idx);
+	while (c->hdr_len == 0) {
+		int rc = http_parse(c);
+		if (rc == 0)
+			break;
+		if (!c->http_hdr && !(c->http_hdr = pool_get(r, WS_POOL_HDR))) {
+			free_client(me, idx);
+			return -1;
+		}
+		if (rc < 0) {
+			/* answer the error, then close: the stream cannot be resynced */
+			c->keep_alive = 0;
+			c->lingering = 1;
+			if (rc == HP_ERR_BAD)
+				http_status_response(c, 400, "Bad Request");
+			else if (rc == HP_ERR_BIG && c->req.state < HP_BODY)
+				http_status_response(c, 431, "Request Header Fields Too Large");
+			else
+				http_status_response(c, 413, "Payload Too Large");
+			c->rx_len = 0;
+			memset(&c->req, 0, sizeof(c->req));
+			if (http_done(me, idx, http_send_pending(c)) < 0)
+				return -1;
+			break;
+		}
+		if (http_is_upgrade(c)) {
+			/* a failed switch has already dropped the client */
+			if (http_upgrade(me, idx) < 0) {
+				if (c->st != WS_CL_FREE)
+					free_client(me, idx);
+				return -1;
+			}
+			return 0;
+		}
+		c->nreq++;
+		c->keep_alive = http_wants_keep_alive(c)
+				&& c->nreq < WS_HTTP_MAX_REQS;
+		int head = hp_is(c, c->req.method, "HEAD");
+		if (head || hp_is(c, c->req.method, "GET")) {
+			rc = http_prepare_file_response(me, c);
+			if (rc == 0 && head) { /* same headers, no body */
+				c->http_tx = NULL;
+				c->http_len = 0;
+				if (c->file_fd >= 0) {
+					close(c->file_fd);
+					c->file_fd = -1;
+				}
+			}
+		} else {
+			http_status_response(c, 405, "Method Not Allowed");
+			rc = 0;
 		}
-	return -1;
-}
-static void free_http_buf(ws_client_t *c) {
-	if (c->http_tx) {
-		free(c->http_tx);
-		c->http_tx = NULL;
-		c->http_len = c->http_off = 0;
+		/* request handled; drop it and any body, keep what follows */
+		size_t n = c->req.line;
+		c->rx_len -= n;
+		memmove(c->rx, c->rx + n, c->rx_len + 1);
+		memset(&c->req, 0, sizeof(c->req));
+		if (rc == 0)
+			rc = http_send_pending(c);
+		if (http_done(me, idx, rc) < 0)
+			return -1;
+	}
+	/* nothing buffered: the request buffer goes back to the pool */
+	if (c->rx_len == 0 && c->rx) {
+		pool_put(r, WS_POOL_RX, c->rx);
+		c->rx = NULL;
+	}
+	/* the peer has finished sending and every complete request is answered;
+	 * a partial one left in rx can never complete */
+	if (c->rd_eof && c->hdr_len == 0) {
+		free_client(me, idx);
+		return -1;
 	}
+	/* wait for the socket while a response is pending; stop reading once the
+	 * pipelined requests queued behind it fill the buffer, or at EOF. A
+	 * lingering client reads (and discards) only once its error is out. */
+	uint32_t evs = EPOLLERR;
+	if (c->hdr_len)
+		evs |= EPOLLOUT;
+	if (c->lingering ?
+			c->hdr_len == 0 : c->rx_len < WS_RX_BUFSZ - 1 && !c->rd_eof)
+		evs |= EPOLLIN | EPOLLRDHUP;
+	ep_mod(r->epfd, c->fd, evs, ws_tag(me, idx));
+	return 0;
 }
-static void free_client(ao_ws_t *me, int idx) {
-	if (idx < 0)
-		return;
-	free_http_buf(&me->clients[idx]);
-	if (me->clients[idx].fd >= 0) {
-		ep_del(me->epfd, me->clients[idx].fd);
-		close(me->clients[idx].fd);
+
+/* ========================= Pump thread ========================= */
+/* Post to the AO from a reactor. post() would block for good once the AO
+ * stops to join the reactors, so give up (and drop the event) then. */
+static void ws_pump_post(ao_ws_t *me, message_frame_t *e) {
+	while (!post_timeout((base_obj_t*) me, e, 100)) {
+		if (!me->pump_running) {
+			free(e->ptr);
+			return;
+		}
 	}
-	me->clients[idx].fd = -1;
-	me->clients[idx].st = WS_CL_FREE;
 }
-static int outq_push(ws_client_t *c, const char *msg) {
-	int n = (c->out_tail + 1) % WS_OUTQ_LEN;
-	if (n == c->out_head)
+
+/* Drop a WebSocket client and tell the AO */
+static void ws_client_lost(ao_ws_t *me, int idx) {
+	free_client(me, idx);
+	message_frame_t e = { 0 };
+	e.signal = WS_EVT_CLIENT_CLOSED;
+	e.length = sizeof(int);
+	memcpy(e.payload, &idx, sizeof(int));
+	ws_pump_post(me, &e);
+}
+
+/* Send what WS client @p idx has queued; EPOLLOUT stays armed only while the
+ * socket is full. Returns -1 when the client was dropped. */
+static int ws_flush(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	int rc = outq_send(c);
+	if (rc < 0) {
+		ws_client_lost(me, idx);
 		return -1;
-	strncpy(c->out_q[c->out_tail], msg, WS_TX_BUFSZ - 1);
-	c->out_q[c->out_tail][WS_TX_BUFSZ - 1] = '\0';
-	c->out_tail = n;
+	}
+	/* backlogged from the first time the socket fills until the ring drains */
+	if (rc == 0)
+		outq_stalled(c);
+	else if (c->out_st.stall_ms)
+		__atomic_store_n(&c->out_st.stall_ms, 0, __ATOMIC_RELAXED);
+	if (c->out_armed != (rc == 0)) {
+		c->out_armed = (uint8_t) (rc == 0);
+		ep_mod(ws_reactor(me, idx)->epfd, c->fd,
+				EPOLLIN | EPOLLRDHUP | EPOLLERR | (rc ? 0 : EPOLLOUT),
+				ws_tag(me, idx));
+	}
 	return 0;
 }
-static int outq_pop(ws_client_t *c, char *out) {
-	if (c->out_head == c->out_tail)
+
+/* ===================== WebSocket receive ===================== */
+#define WS_RD_HDR     0 /* collecting the header, hneed bytes */
+#define WS_RD_PAYLOAD 1 /* unmasking left payload bytes */
+
+#if WS_MSG_MAX + 5 > WS_RX_BUFSZ
+#error "WS_MSG_MAX must leave room for the deflate tail in a WS_RX_BUFSZ buffer"
+#endif
+
+/* Hand complete message @p m to the AO: text as WS_EVT_WS_MSG_RX, binary as
+ * a WS_EVT_WS_BIN_RX broker frame (WS_SUBPROTOCOL clients only; others'
+ * binary messages are ignored). Returns -1 on a malformed broker frame. */
+static int ws_deliver(ao_ws_t *me, int idx, int binary, const char *m, size_t n) {
+	message_frame_t e = { 0 };
+	memcpy(e.payload, &idx, sizeof(int));
+	if (!binary) {
+		e.signal = WS_EVT_WS_MSG_RX;
+		e.length = (uint32_t) (sizeof(int) + n + 1);
+		if (n + 1 <= sizeof(e.payload) - sizeof(int)) {
+			memcpy(e.payload + sizeof(int), m, n);
+		} else {
+			if (!(e.ptr = malloc(n + 1)))
+				return 0;
+			memcpy(e.ptr, m, n);
+			e.ptr[n] = '\0';
+		}
+		ws_pump_post(me, &e);
+		return 0;
+	}
+	if (!me->clients[idx].binary)
 		return 0;
-	strcpy(out, c->out_q[c->out_head]);
-	c->out_head = (c->out_head + 1) % WS_OUTQ_LEN;
-	return 1;
-}
 
-/* Build an HTTP response for a static file into client->http_tx */
-static int http_prepare_file_response(const ao_ws_t *me, ws_client_t *c,
-		const char *req) {
-	char path[512];
-	if (!http_get_path(req, path, sizeof(path)))
+	/* a broker frame, handed over without its length */
+	uint32_t sig = 0, len = 0;
+	for (int k = 0; k < 4 && n >= WS_BIN_HDR; k++) {
+		sig = sig << 8 | (uint8_t) m[k];
+		len = len << 8 | (uint8_t) m[4 + k];
+	}
+	if (n < WS_BIN_HDR || len != n - WS_BIN_HDR || len > MAX_PAYLOAD_SIZE)
 		return -1;
-	sanitize_path(path);
-
-	char full[WS_DOCROOT_MAX + 512];
-	if (strcmp(path, "/") == 0) {
-		snprintf(full, sizeof(full), "%s/index.html", me->docroot);
+	e.signal = WS_EVT_WS_BIN_RX;
+	e.length = (uint32_t) (2 * sizeof(uint32_t) + len);
+	memcpy(e.payload + sizeof(int), &sig, sizeof(sig));
+	if (len <= sizeof(e.payload) - 2 * sizeof(uint32_t)) {
+		memcpy(e.payload + 2 * sizeof(uint32_t), m + WS_BIN_HDR, len);
 	} else {
-		const char *p = (path[0] == '/') ? path + 1 : path;
-		snprintf(full, sizeof(full), "%s/%s", me->docroot, p);
+		if (!(e.ptr = malloc(len)))
+			return 0;
+		memcpy(e.ptr, m + WS_BIN_HDR, len);
 	}
+	ws_pump_post(me, &e);
+	return 0;
+}
 
-	int fd = open(full, O_RDONLY);
-	if (fd < 0) {
-		const char *body = "<h1>404 Not Found</h1>";
-		const char *ctype = "text/html; charset=utf-8";
-		char hdr[256];
-		int blen = (int) strlen(body);
-		int hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 404 Not Found\r\n"
-				"Content-Type: %s\r\n"
-				"Content-Length: %d\r\n"
-				"Connection: close\r\n"
-				"\r\n", ctype, blen);
-		c->http_tx = malloc((size_t) hlen + blen);
-		if (!c->http_tx)
+/* Deliver the reassembled message of client @p idx, inflated first when it
+ * was sent compressed, and release its buffer */
+static int ws_rd_message(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	ws_reactor_t *r = ws_reactor(me, idx);
+	ws_frame_rd_t *rd = &c->rd;
+	char *m = rd->msg, *z = NULL;
+	int n = (int) rd->msg_len, rc = 0;
+	if (rd->msg_deflated) {
+		if (!(z = pool_get(r, WS_POOL_RX)))
 			return -1;
-		memcpy(c->http_tx, hdr, (size_t) hlen);
-		memcpy(c->http_tx + hlen, body, (size_t) blen);
-		c->http_len = (size_t) hlen + blen;
-		c->http_off = 0;
-		return 0;
+		n = pmd_inflate(c, (unsigned char*) m, rd->msg_len, z, WS_MSG_MAX + 1);
+		m = z;
 	}
+	if (n < 0 || ws_deliver(me, idx, rd->msg_op == 0x2, m, (size_t) n) < 0)
+		rc = -1;
+	pool_put(r, WS_POOL_RX, z);
+	pool_put(r, WS_POOL_RX, rd->msg);
+	rd->msg = NULL;
+	rd->msg_len = 0;
+	rd->msg_op = rd->msg_deflated = 0;
+	return rc;
+}
 
-	struct stat st;
-	if (fstat(fd, &st) < 0) {
-		close(fd);
+/* A frame header is complete: check it against the state of the message in
+ * progress. Returns -1 on a protocol error or an oversized message. */
+static int ws_rd_header(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	ws_frame_rd_t *rd = &c->rd;
+	const uint8_t *h = rd->hdr;
+	int rsv1 = (h[0] & 0x40) != 0;
+	uint64_t len = h[1] & 0x7F;
+	if (len == 126) {
+		len = (uint64_t) h[2] << 8 | h[3];
+	} else if (len == 127) {
+		len = 0;
+		for (int i = 0; i < 8; i++)
+			len = len << 8 | h[2 + i];
+	}
+	rd->fin = (h[0] & 0x80) != 0;
+	rd->opcode = h[0] & 0x0F;
+	rd->left = len;
+	rd->pos = 0;
+	if (h[0] & 0x30)
+		return -1; /* RSV2/3 not supported */
+
+	/* control frames: close, ping, pong, whole and short, any time */
+	if (rd->opcode & 0x08) {
+		if (rd->opcode > 0xA || !rd->fin || len > sizeof(rd->ctl) || rsv1)
+			return -1;
+		return 0;
+	}
+	/* data frames: text or binary opens a message, continuation extends it */
+	if (rd->opcode == 0x0) {
+		if (!rd->msg_op || rsv1)
+			return -1;
+	} else if (rd->opcode == 0x1 || rd->opcode == 0x2) {
+		if (rd->msg_op || (rsv1 && !c->pmd))
+			return -1;
+		rd->msg_op = rd->opcode;
+		rd->msg_deflated = (uint8_t) rsv1;
+	} else {
 		return -1;
 	}
-	size_t fsz = (size_t) st.st_size;
-	const char *ctype = mime_from_ext(full);
-
-	char hdr[256];
-	int hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
-			"Content-Type: %s\r\n"
-			"Content-Length: %zu\r\n"
-			"Connection: close\r\n"
-			"\r\n", ctype, fsz);
+	if (len > WS_MSG_MAX - rd->msg_len)
+		return -1; /* larger than WS_MSG_MAX */
+	if (!rd->msg && !(rd->msg = pool_get(ws_reactor(me, idx), WS_POOL_RX)))
+		return -1;
+	return 0;
+}
 
-	c->http_tx = malloc((size_t) hlen + fsz);
-	if (!c->http_tx) {
-		close(fd);
+/* The payload of the current frame is in: act on a control frame, or deliver
+ * the message after its final fragment */
+static int ws_rd_frame(ao_ws_t *me, int idx) {
+	ws_client_t *c = &me->clients[idx];
+	ws_frame_rd_t *rd = &c->rd;
+	rd->state = WS_RD_HDR;
+	rd->hlen = 0;
+	rd->hneed = 2;
+	switch (rd->opcode) {
+	case 0x8: /* close: the caller drops the TCP connection */
 		return -1;
+	case 0x9: { /* ping -> pong same payload, queued behind data */
+		ws_frame_t *f = ws_frame_new(0xA, rd->ctl, rd->pos);
+		if (f) {
+			(void) outq_push(c, f, 0);
+			ws_frame_put(f);
+		}
+		return 0;
+	}
+	case 0xA: /* pong: ignored */
+		return 0;
+	default:
+		return rd->fin ? ws_rd_message(me, idx) : 0;
 	}
-	memcpy(c->http_tx, hdr, (size_t) hlen);
+}
 
-	size_t off = (size_t) hlen;
-	while (off < (size_t) hlen + fsz) {
-		ssize_t r = read(fd, c->http_tx + off, (size_t) hlen + fsz - off);
-		if (r < 0) {
-			if (errno == EINTR)
+/* Feed @p n received bytes of client @p idx to its frame decoder. A frame or
+ * message may end anywhere, including inside the header. Returns -1 when the
+ * connection must be dropped. */
+static int ws_rd_feed(ao_ws_t *me, int idx, const uint8_t *p, size_t n) {
+	ws_frame_rd_t *rd = &me->clients[idx].rd;
+	while (n) {
+		if (rd->state == WS_RD_HDR) {
+			size_t k = (size_t) (rd->hneed - rd->hlen);
+			if (k > n)
+				k = n;
+			memcpy(rd->hdr + rd->hlen, p, k);
+			rd->hlen = (uint8_t) (rd->hlen + k);
+			p += k;
+			n -= k;
+			if (rd->hlen < rd->hneed)
+				break;
+			if (rd->hneed == 2) { /* now the length is known: add mask */
+				uint8_t l = rd->hdr[1] & 0x7F;
+				if (!(rd->hdr[1] & 0x80))
+					return -1; /* clients must mask */
+				rd->hneed = (uint8_t) (2 + (l == 126 ? 2 : l == 127 ? 8 : 0) + 4);
 				continue;
-			free_http_buf(c);
-			close(fd);
-			return -1;
+			}
+			if (ws_rd_header(me, idx) < 0)
+				return -1;
+			rd->state = WS_RD_PAYLOAD;
+			if (rd->left == 0 && ws_rd_frame(me, idx) < 0)
+				return -1;
+			continue;
 		}
-		if (r == 0)
-			break;
-		off += (size_t) r;
-	}
-	close(fd);
 
-	c->http_len = off;
-	c->http_off = 0;
+		/* WS_RD_PAYLOAD: unmask straight into the message or control buffer */
+		const uint8_t *mask = rd->hdr + rd->hneed - 4;
+		uint8_t *dst = (rd->opcode & 0x08) ?
+				rd->ctl + rd->pos : (uint8_t*) rd->msg + rd->msg_len;
+		size_t k = rd->left < n ? (size_t) rd->left : n;
+		for (size_t i = 0; i < k; i++)
+			dst[i] = p[i] ^ mask[(rd->pos + i) & 3];
+		rd->pos += (uint32_t) k;
+		rd->left -= k;
+		if (!(rd->opcode & 0x08))
+			rd->msg_len += k;
+		p += k;
+		n -= k;
+		if (rd->left == 0 && ws_rd_frame(me, idx) < 0)
+			return -1;
+	}
 	return 0;
 }
 
-/* ========================= Pump thread ========================= */
-static void pump_handle_notify(ao_ws_t *me) {
-	uint64_t n;
-	while (read(me->notifyfd, &n, sizeof(n)) > 0) {
+/* Read what WS client @p idx sent and decode it. Returns -1 when the
+ * connection must be dropped. */
+static int ws_receive(ao_ws_t *me, int idx) {
+	uint8_t buf[4096];
+	ssize_t n = read(me->clients[idx].fd, buf, sizeof(buf));
+	if (n < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+	if (n == 0)
+		return -1; /* peer closed */
+	return ws_rd_feed(me, idx, buf, (size_t) n);
+}
+
+/* Queued, unsent frame of @p c with conflation key @p key that may be
+ * replaced, or NULL. A frame deflated with context takeover may not: the
+ * peer's inflater must see it. */
+static ws_out_t* outq_find(ws_client_t *c, uint32_t key) {
+	for (int i = c->out_head; i != c->out_tail; i = (i + 1) % c->out_cap) {
+		ws_out_t *o = &c->out_q[i];
+		if (o->key == key && o->off == 0
+				&& (!(o->f->buf[0] & 0x40) || (c->pmd & WS_PMD_SERVER_NCT)))
+			return o;
 	}
-	for (;;) {
-		int ok = 0, target = -2;
-		char msg[WS_TX_BUFSZ];
-		pthread_mutex_lock(&me->cmd.mx);
-		if (me->cmd.head != me->cmd.tail) {
-			target = me->cmd.q[me->cmd.head].target_idx;
-			strcpy(msg, me->cmd.q[me->cmd.head].msg);
-			me->cmd.head = (me->cmd.head + 1)
-					% (int) (sizeof(me->cmd.q) / sizeof(me->cmd.q[0]));
-			ok = 1;
-		}
-		pthread_mutex_unlock(&me->cmd.mx);
-		if (!ok)
-			break;
+	return NULL;
+}
+
+/* Queue data frame @p f on WS client @p idx, compressed for it when
+ * permessage-deflate is on. A WS_OUT_CONFLATE message replaces its queued
+ * predecessor; otherwise, over WS_OUT_BUDGET, it is dropped and the client
+ * counts as backlogged. Returns -1 when dropped. */
+static int ws_queue_frame(ws_reactor_t *r, int idx, ws_frame_t *f) {
+	ws_client_t *c = &r->ws->clients[idx];
+	ws_out_t *o = NULL;
+	if (f->key && r->ws->out_policy[f->cls] == WS_OUT_CONFLATE)
+		o = outq_find(c, f->key);
+	if (!o && c->out_bytes + f->len > WS_OUT_BUDGET) {
+		/* checked first: a deflated message must not be dropped */
+		__atomic_add_fetch(&c->out_st.dropped, 1, __ATOMIC_RELAXED);
+		outq_stalled(c);
+		return -1;
+	}
+	ws_frame_t *z = c->pmd ? pmd_deflate(r, c, f) : NULL;
+	ws_frame_t *q = z ? z : f;
+	int rc = 0;
+	if (o) {
+		ws_frame_get(q);
+		c->out_bytes = c->out_bytes - o->f->len + q->len;
+		ws_frame_put(o->f);
+		o->f = q;
+		__atomic_add_fetch(&c->out_st.conflated, 1, __ATOMIC_RELAXED);
+		outq_stats(c);
+	} else {
+		rc = outq_push(c, q, f->key);
+	}
+	if (!z)
+		return rc;
+	ws_frame_put(z);
+	if (rc < 0)
+		c->pmd |= WS_PMD_TX_OFF; /* the context holds a message never sent */
+	return rc;
+}
 
+static void pump_handle_notify(ws_reactor_t *r) {
+	ao_ws_t *me = r->ws;
+	uint64_t n;
+	uint8_t queued[WS_MAX_CLIENTS] = { 0 };
+	(void) read(r->notifyfd, &n, sizeof(n));
+
+	/* disarm before looking at tail: anything pushed after this point
+	 * either shows up below or writes notifyfd again */
+	__atomic_store_n(&r->cmd.armed, 0, __ATOMIC_SEQ_CST);
+	uint32_t head = r->cmd.head;
+	uint32_t tail = __atomic_load_n(&r->cmd.tail, __ATOMIC_SEQ_CST);
+	for (; head != tail; head++) {
+		int target = r->cmd.q[head & (WS_CMD_LEN - 1)].target_idx;
+		ws_frame_t *f = r->cmd.q[head & (WS_CMD_LEN - 1)].f;
+		__atomic_store_n(&r->cmd.head, head + 1, __ATOMIC_RELEASE);
+
+		/* encoded once; every target queues a reference, or its own
+		 * compressed copy */
 		if (target < 0) {
-			for (int i = 0; i < WS_MAX_CLIENTS; i++)
-				if (me->clients[i].st == WS_CL_WS) {
-					if (outq_push(&me->clients[i], msg) == 0)
-						ep_mod(me->epfd, me->clients[i].fd,
-						EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLOUT);
-				}
+			for (int i = r->first; i < r->first + r->count; i++)
+				if (me->clients[i].st == WS_CL_WS
+						&& (target != WS_TO_MASK || ws_frame_to_has(f, i))
+						&& ws_queue_frame(r, i, f) == 0)
+					queued[i] = 1;
 		} else {
-			if (target < WS_MAX_CLIENTS && me->clients[target].st == WS_CL_WS) {
-				if (outq_push(&me->clients[target], msg) == 0)
-					ep_mod(me->epfd, me->clients[target].fd,
-					EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLOUT);
-			}
+			if (target < WS_MAX_CLIENTS && me->clients[target].st == WS_CL_WS
+					&& ws_queue_frame(r, target, f) == 0)
+				queued[target] = 1;
 		}
+		ws_frame_put(f);
 	}
+
+	/* one gathered write per client for everything queued by this wake-up;
+	 * clients already waiting for EPOLLOUT are sent to from there */
+	for (int i = r->first; i < r->first + r->count; i++)
+		if (queued[i] && !me->clients[i].out_armed)
+			(void) ws_flush(me, i);
 }
 
+/* Reactor thread: accepts on its own listener and serves its partition.
+ * The eventfd and, on reactor 0, the inotify fd are created by
+ * ws_on_entry_initialisation() before the threads start. */
 static void* ws_pump(void *arg) {
-	ao_ws_t *me = (ao_ws_t*) arg;
+	ws_reactor_t *r = (ws_reactor_t*) arg;
+	ao_ws_t *me = r->ws;
 
-	me->epfd = epoll_create1(0);
-	if (me->epfd < 0) {
+	r->epfd = epoll_create1(0);
+	if (r->epfd < 0) {
 		message_frame_t e = { 0 };
 		e.signal = WS_CHANGE_STATE_ERR;
-		post((base_obj_t*) me, e);
+		ws_pump_post(me, &e);
 		return NULL;
 	}
 
-	me->listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	/* with several reactors each binds its own listener to the port and the
+	 * kernel balances connections between them */
+	r->listenfd = socket(AF_INET, SOCK_STREAM, 0);
 	int opt = 1;
-	setsockopt(me->listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-	set_nonblock(me->listenfd);
+	setsockopt(r->listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+	if (me->nreactors > 1)
+		setsockopt(r->listenfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+	set_nonblock(r->listenfd);
 	struct sockaddr_in a = { 0 };
 	a.sin_family = AF_INET;
 	a.sin_addr.s_addr = INADDR_ANY;
 	a.sin_port = htons(me->port);
-	if (bind(me->listenfd, (struct sockaddr*) &a, sizeof(a)) < 0
-			|| listen(me->listenfd, 128) < 0) {
+	if (bind(r->listenfd, (struct sockaddr*) &a, sizeof(a)) < 0
+			|| listen(r->listenfd, 128) < 0) {
 		message_frame_t e = { 0 };
 		e.signal = WS_CHANGE_STATE_ERR;
-		post((base_obj_t*) me, e);
+		ws_pump_post(me, &e);
 		return NULL;
 	}
 
-	me->notifyfd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
-
-	ep_add(me->epfd, me->listenfd, EPOLLIN);
-	ep_add(me->epfd, me->notifyfd, EPOLLIN);
+	ep_add(r->epfd, r->listenfd, EPOLLIN, WS_TAG_LISTEN);
+	ep_add(r->epfd, r->notifyfd, EPOLLIN, WS_TAG_NOTIFY);
+	if (r->id == 0 && me->cache.ifd >= 0)
+		ep_add(r->epfd, me->cache.ifd, EPOLLIN, WS_TAG_INOTIFY);
 
 	struct epoll_event ev[64];
+	uint64_t last_sweep = ws_now_ms();
 
 	while (me->pump_running) {
-		int n = epoll_wait(me->epfd, ev, 64, -1);
+		int n = epoll_wait(r->epfd, ev, 64, 1000);
 		if (n < 0) {
 			if (errno == EINTR)
 				continue;
 			break;
 		}
+		uint64_t now = ws_now_ms();
+
+		/* drop HTTP connections idle past the keep-alive timeout, and evict
+		 * WS clients backlogged for WS_OUT_STALL_MS: they would only pin
+		 * their queue and drop what is sent to them */
+		if (now - last_sweep >= 1000) {
+			last_sweep = now;
+			for (int i = r->first; i < r->first + r->count; i++) {
+				ws_client_t *c = &me->clients[i];
+				if (c->st == WS_CL_HTTP
+						&& now - c->last_io_ms >= WS_HTTP_IDLE_MS) {
+					free_client(me, i);
+				} else if (c->st == WS_CL_WS && c->out_st.stall_ms
+						&& now - c->out_st.stall_ms >= WS_OUT_STALL_MS) {
+					__atomic_add_fetch(&me->evicted, 1, __ATOMIC_RELAXED);
+					ws_client_lost(me, i);
+				}
+			}
+		}
 
 		for (int i = 0; i < n; i++) {
-			int fd = ev[i].data.fd;
+			uint64_t tag = ev[i].data.u64;
 			uint32_t ee = ev[i].events;
 
-			if (fd == me->notifyfd && (ee & EPOLLIN)) {
-				pump_handle_notify(me);
+			if (tag == WS_TAG_NOTIFY && (ee & EPOLLIN)) {
+				pump_handle_notify(r);
+				continue;
+			}
+
+			if (tag == WS_TAG_INOTIFY) {
+				asset_handle_inotify(me);
 				continue;
 			}
 
-			if (fd == me->listenfd && (ee & EPOLLIN)) {
+			if (tag == WS_TAG_LISTEN && (ee & EPOLLIN)) {
 				for (;;) {
-					int cfd = accept(me->listenfd, NULL, NULL);
+					int cfd = accept(r->listenfd, NULL, NULL);
 					if (cfd < 0) {
 						if (errno == EAGAIN || errno == EWOULDBLOCK)
 							break;
@@ -534,253 +2150,553 @@ static void* ws_pump(void *arg) {
 							break;
 					}
 					set_nonblock(cfd);
-					int idx = alloc_client(me->clients);
+					int idx = alloc_client(r);
 					if (idx < 0) {
 						close(cfd);
 						continue;
 					}
 					me->clients[idx].fd = cfd;
 					me->clients[idx].st = WS_CL_HTTP;
-					me->clients[idx].conn_id = ++me->id_seq;
-					ep_add(me->epfd, cfd, EPOLLIN | EPOLLRDHUP | EPOLLERR);
+					me->clients[idx].conn_id = __atomic_add_fetch(&me->id_seq, 1,
+							__ATOMIC_RELAXED);
+					me->clients[idx].last_io_ms = now;
+					ep_add(r->epfd, cfd, EPOLLIN | EPOLLRDHUP | EPOLLERR,
+							ws_tag(me, idx));
 					message_frame_t e = { 0 };
 					e.signal = WS_EVT_NEW_CONN;
 					e.length = sizeof(int);
 					memcpy(e.payload, &idx, sizeof(int));
-					post((base_obj_t*) me, e);
+					ws_pump_post(me, &e);
 				}
 				continue;
 			}
 
-			/* find client */
-			int idx = -1;
-			for (int k = 0; k < WS_MAX_CLIENTS; k++)
-				if (me->clients[k].st != WS_CL_FREE
-						&& me->clients[k].fd == fd) {
-					idx = k;
-					break;
-				}
-			if (idx < 0)
+			/* resolve client from the tag; skip events for a freed/reused slot */
+			uint32_t slot = (uint32_t) tag;
+			if (slot < (uint32_t) r->first
+					|| slot >= (uint32_t) (r->first + r->count))
 				continue;
+			int idx = (int) slot;
 			ws_client_t *c = &me->clients[idx];
+			if (c->st == WS_CL_FREE || c->gen != (uint32_t) (tag >> 32))
+				continue;
+			int fd = c->fd;
 
-			if (ee & (EPOLLERR | EPOLLRDHUP | EPOLLHUP)) {
-				free_client(me, idx);
-				message_frame_t e = { 0 };
-				e.signal = WS_EVT_CLIENT_CLOSED;
-				e.length = sizeof(int);
-				memcpy(e.payload, &idx, sizeof(int));
-				post((base_obj_t*) me, e);
+			/* a FIN (EPOLLRDHUP) alone does not end the connection: the
+			 * requests or frames ahead of it are read and answered first, and
+			 * the read returning 0 closes it */
+			if (ee & (EPOLLERR | EPOLLHUP)) {
+				ws_client_lost(me, idx);
 				continue;
 			}
 
 			/* HTTP receive / upgrade */
-			if ((ee & EPOLLIN) && c->st == WS_CL_HTTP) {
-				int r = read(fd, c->rx, sizeof(c->rx) - 1);
-				if (r <= 0) {
+			c->last_io_ms = now;
+			if ((ee & EPOLLIN) && c->lingering && c->hdr_len == 0) {
+				char sink[512];
+				ssize_t r = read(fd, sink, sizeof(sink));
+				if (r == 0
+						|| (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+					free_client(me, idx);
+				continue;
+			}
+			if ((ee & EPOLLIN) && c->st == WS_CL_HTTP && !c->lingering
+					&& !c->upgrading && !c->rd_eof
+					&& c->rx_len < WS_RX_BUFSZ - 1) {
+				if (!c->rx && !(c->rx = pool_get(r, WS_POOL_RX))) {
 					free_client(me, idx);
 					continue;
 				}
-				c->rx[r] = '\0';
-
-				if (http_is_upgrade(c->rx)) {
-					char key[128];
-					if (!http_get_header(c->rx, "Sec-WebSocket-Key:", key,
-							sizeof(key))) {
-						free_client(me, idx);
-						continue;
-					}
-					char *accept = ws_accept_from_key(key);
-					char resp[512];
-					int n2 = snprintf(resp, sizeof(resp),
-							"HTTP/1.1 101 Switching Protocols\r\n"
-									"Upgrade: websocket\r\n"
-									"Connection: Upgrade\r\n"
-									"Sec-WebSocket-Accept: %s\r\n\r\n", accept);
-					free(accept);
-					if (write(fd, resp, n2) < 0) {
-						free_client(me, idx);
-						continue;
-					}
-					c->st = WS_CL_WS;
-					message_frame_t e = { 0 };
-					e.signal = WS_EVT_WS_OPEN;
-					e.length = sizeof(int);
-					memcpy(e.payload, &idx, sizeof(int));
-					post((base_obj_t*) me, e);
-				} else {
-					free_http_buf(c);
-					if (http_prepare_file_response(me, c, c->rx) < 0) {
-						free_client(me, idx);
-						continue;
-					}
-					while (c->http_off < c->http_len) {
-						ssize_t w = write(fd, c->http_tx + c->http_off,
-								c->http_len - c->http_off);
-						if (w > 0) {
-							c->http_off += (size_t) w;
-							continue;
-						}
-						if (w < 0
-								&& (errno == EAGAIN || errno == EWOULDBLOCK)) {
-							ep_mod(me->epfd, fd,
-							EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLOUT);
-							break;
-						}
-						break;
-					}
-					if (c->http_off >= c->http_len) {
-						free_client(me, idx);
-					}
+				ssize_t r = read(fd, c->rx + c->rx_len,
+						WS_RX_BUFSZ - 1 - c->rx_len);
+				if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					continue;
+				if (r < 0) {
+					free_client(me, idx);
+					continue;
 				}
+				if (r == 0)
+					c->rd_eof = 1;
+				c->rx_len += (size_t) r;
+				c->rx[c->rx_len] = '\0';
+				if (http_serve(me, idx) < 0)
+					continue;
 			}
 
-			/* HTTP EPOLLOUT (finish sending file) */
-			if ((ee & EPOLLOUT) && c->st == WS_CL_HTTP && c->http_tx) {
-				while (c->http_off < c->http_len) {
-					ssize_t w = write(fd, c->http_tx + c->http_off,
-							c->http_len - c->http_off);
-					if (w > 0) {
-						c->http_off += (size_t) w;
-						continue;
-					}
-					if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
-						break;
-					break;
-				}
-				if (c->http_off >= c->http_len) {
+			/* 101 fully sent: the connection is a WebSocket from here on */
+			if ((ee & EPOLLOUT) && c->upgrading) {
+				int rc = http_send_pending(c);
+				if (rc < 0)
 					free_client(me, idx);
-				} else {
-					ep_mod(me->epfd, fd,
-					EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLOUT);
-				}
+				else if (rc > 0)
+					(void) ws_upgraded(me, idx);
+				continue;
 			}
 
-			/* WebSocket receive */
-			if ((ee & EPOLLIN) && c->st == WS_CL_WS) {
-				char text[WS_TX_BUFSZ] = { 0 };
-				int t = ws_read_text(fd, text, sizeof(text));
-				if (t == -2) {
-					/* would block (shouldn't happen since EPOLLIN), ignore */
+			/* HTTP EPOLLOUT (finish the response, then the next pipelined one) */
+			if ((ee & EPOLLOUT) && c->st == WS_CL_HTTP && c->hdr_len) {
+				int rc = http_done(me, idx, http_send_pending(c));
+				if (rc < 0)
 					continue;
-				} else if (t < 0) {
-					free_client(me, idx);
-					message_frame_t e = { 0 };
-					e.signal = WS_EVT_CLIENT_CLOSED;
-					e.length = sizeof(int);
-					memcpy(e.payload, &idx, sizeof(int));
-					post((base_obj_t*) me, e);
+				if (rc > 0 && !c->lingering && http_serve(me, idx) < 0)
 					continue;
-				} else if (t == 0) {
-					/* control frame handled (ping/pong), nothing to deliver */
+			}
+
+			/* WebSocket receive */
+			if ((ee & EPOLLIN) && c->st == WS_CL_WS) {
+				if (ws_receive(me, idx) < 0) {
+					ws_client_lost(me, idx);
 					continue;
 				}
-				/* t > 0: deliver text to AO layer */
-				message_frame_t e = { 0 };
-				e.signal = WS_EVT_WS_MSG_RX;
-				e.length = (uint16_t) (sizeof(int) + t + 1);
-				memcpy(e.payload, &idx, sizeof(int));
-				memcpy(e.payload + sizeof(int), text, (size_t) t + 1);
-				post((base_obj_t*) me, e);
+				/* a ping may have queued a pong */
+				if (!c->out_armed && c->out_head != c->out_tail)
+					(void) ws_flush(me, idx);
+				continue;
 			}
 
 			/* WebSocket send */
-			if ((ee & EPOLLOUT) && c->st == WS_CL_WS) {
-				char out[WS_TX_BUFSZ];
-				while (outq_pop(c, out)) {
-					if (ws_send_text(fd, out) < 0) {
-						free_client(me, idx);
-						break;
-					}
-				}
-				if (c->st == WS_CL_WS && c->out_head == c->out_tail) {
-					ep_mod(me->epfd, fd, EPOLLIN | EPOLLRDHUP | EPOLLERR);
-				}
-			}
+			if ((ee & EPOLLOUT) && c->st == WS_CL_WS)
+				(void) ws_flush(me, idx);
 		}
 	}
 	return NULL;
 }
 
 /* ==================== FSM entry/handler ==================== */
+/* Signal the FSM from one of its own actions: through its internal queue,
+ * or at the head of the AO queue should that be full. Not post(): it blocks
+ * while the AO queue is full, and only this thread drains it. */
+static void ws_signal_self(fsm_t *fsm, uint32_t signal) {
+	message_frame_t e = { 0 };
+	e.signal = signal;
+	if (!fsm_post_internal(fsm, &e))
+		(void) try_post((base_obj_t*) fsm->super, &e, 1);
+}
 static void ws_on_entry_initialisation(fsm_t *fsm) {
 	topic_config_t config[] = { { .topic = WS_QUERY_RX_CMD(0, 0), .start =
-			WS_QUERY_RX_CMD(0, 0), .type = MASK }, {
+			WS_QUERY_RX_CMD(0, 0), .type = MASK }, { .topic =
+			WS_LIVE_UPDATE(0, 0), .start = WS_LIVE_UPDATE(0, 0), .type = MASK }, {
 			.topic = WS_CHANGE_STATE_OP, .type = EXACT_MATCH }, { .topic =
 	WS_CHANGE_STATE_ERR, .type = EXACT_MATCH } };
 	ao_ws_t *me = (ao_ws_t*) fsm->super;
 	if (!me->pump_running) {
+		/* without inotify the cache could go stale, so it stays disabled */
+		me->cache.ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		for (int i = 0; i < me->nreactors; i++)
+			me->reactor[i].notifyfd = eventfd(0, EFD_NONBLOCK);
 		me->pump_running = 1;
-		if (pthread_create(&me->pump_tid, NULL, ws_pump, me) != 0) {
-			me->pump_running = 0;
-			message_frame_t e = { 0 };
-			e.signal = WS_CHANGE_STATE_ERR;
-			post((base_obj_t*) me, e);
-			return;
+		for (int i = 0; i < me->nreactors; i++) {
+			ws_reactor_t *r = &me->reactor[i];
+			/* the error state joins the reactors already started */
+			if (pthread_create(&r->tid, NULL, ws_pump, r) != 0) {
+				ws_signal_self(fsm, WS_CHANGE_STATE_ERR);
+				return;
+			}
+			r->started = 1;
 		}
-		pthread_detach(me->pump_tid);
 	}
 	broker_subscribe(((base_obj_t*) fsm->super)->broker, config,
 			sizeof(config) / sizeof(config[0]), (base_obj_t*) fsm->super);
-	message_frame_t evt = { 0 };
-	evt.signal = WS_CHANGE_STATE_OP;
-	post((base_obj_t*) me, evt);
+	ws_signal_self(fsm, WS_CHANGE_STATE_OP);
 }
 static void ws_on_entry_operational(fsm_t *fsm) {
 	(void) fsm;
 }
 static void ws_on_entry_error(fsm_t *fsm) {
 	ao_ws_t *me = (ao_ws_t*) fsm->super;
-	if (me->epfd > 0) {
-		close(me->epfd);
-		me->epfd = -1;
+	/* one reactor failing leaves the others serving: stop and join them all
+	 * before their fds and clients go. pump_running stays 0 so a later
+	 * initialisation starts afresh. */
+	me->pump_running = 0;
+	for (int k = 0; k < me->nreactors; k++) {
+		ws_reactor_t *r = &me->reactor[k];
+		uint64_t one = 1;
+		if (!r->started)
+			continue;
+		if (r->notifyfd >= 0)
+			(void) write(r->notifyfd, &one, sizeof(one));
+		pthread_join(r->tid, NULL);
+		r->started = 0;
 	}
-	if (me->listenfd > 0) {
-		close(me->listenfd);
-		me->listenfd = -1;
+	for (int k = 0; k < me->nreactors; k++) {
+		ws_reactor_t *r = &me->reactor[k];
+		if (r->epfd > 0) {
+			close(r->epfd);
+			r->epfd = -1;
+		}
+		if (r->listenfd > 0) {
+			close(r->listenfd);
+			r->listenfd = -1;
+		}
+		if (r->notifyfd > 0) {
+			close(r->notifyfd);
+			r->notifyfd = -1;
+		}
+		for (int i = r->first; i < r->first + r->count; i++)
+			if (me->clients[i].st != WS_CL_FREE) {
+				client_release(r, &me->clients[i]);
+				close(me->clients[i].fd);
+				me->clients[i].st = WS_CL_FREE;
+			}
+		uint32_t tail = __atomic_load_n(&r->cmd.tail, __ATOMIC_ACQUIRE);
+		for (; r->cmd.head != tail; r->cmd.head++)
+			ws_frame_put(r->cmd.q[r->cmd.head & (WS_CMD_LEN - 1)].f);
+		pool_flush(r);
+		free(r->zbuf);
+		r->zbuf = NULL;
+		r->zcap = 0;
 	}
-	if (me->notifyfd > 0) {
-		close(me->notifyfd);
-		me->notifyfd = -1;
+	pthread_mutex_lock(&me->cache.mx);
+	asset_flush(me);
+	pthread_mutex_unlock(&me->cache.mx);
+	live_flush(me);
+	if (me->cache.ifd >= 0) {
+		close(me->cache.ifd);
+		me->cache.ifd = -1;
 	}
-	for (int i = 0; i < WS_MAX_CLIENTS; i++)
-		if (me->clients[i].st != WS_CL_FREE) {
-			free_http_buf(&me->clients[i]);
-			close(me->clients[i].fd);
-			me->clients[i].st = WS_CL_FREE;
-		}
+	me->cache.ndirs = 0;
 }
 
 void ws_parse_json(const char *json_str, message_frame_t *msg) {
 	cJSON *root = cJSON_Parse(json_str);
-	if (!root || !cJSON_IsArray(root)) {
+	if (!root || !cJSON_IsObject(root)) {
 		fprintf(stderr, "invalid JSON\n");
+		cJSON_Delete(root);
 		return;
 	}
 	cJSON *signal = cJSON_GetObjectItem(root, "signal");
 	cJSON *payload = cJSON_GetObjectItem(root, "payload");
-	if (!cJSON_IsNumber(signal) || cJSON_IsString(payload)) {
-		return;
+	if (cJSON_IsNumber(signal)) {
+		msg->signal = (uint32_t) signal->valuedouble;
+		if (cJSON_IsString(payload)) {
+			size_t len = strlen(payload->valuestring);
+			if (len > sizeof(msg->payload) - 1)
+				len = sizeof(msg->payload) - 1;
+			memcpy(msg->payload, payload->valuestring, len);
+			msg->payload[len] = '\0';
+			msg->length = (uint32_t) len;
+		}
 	}
-	msg->signal = signal->valueint;
-	msg->length = strlen(payload->valuestring);
-	memcpy(msg->payload, payload->valuestring, msg->length);
 
 	cJSON_Delete(root);
-	cJSON_Delete(signal);
-	cJSON_Delete(payload);
 }
 
-char* ws_json_str(message_frame_t msg) {
-	cJSON *root = cJSON_CreateObject();
+/* Hand a reference to @p f to reactor @p r and wake it, unless a wake-up is
+ * already pending. AO thread only: it is the ring's single producer. */
+static void ws_cmd_queue(ws_reactor_t *r, int target_idx, ws_frame_t *f) {
+	uint32_t tail = r->cmd.tail;
+	if (tail - __atomic_load_n(&r->cmd.head, __ATOMIC_ACQUIRE) >= WS_CMD_LEN) {
+		ws_frame_put(f); /* ring full: dropped, the reactor is armed already */
+		__atomic_add_fetch(&r->cmd.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	r->cmd.q[tail & (WS_CMD_LEN - 1)].target_idx = target_idx;
+	r->cmd.q[tail & (WS_CMD_LEN - 1)].f = f;
+	__atomic_store_n(&r->cmd.tail, tail + 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_exchange_n(&r->cmd.armed, 1, __ATOMIC_SEQ_CST)) {
+		uint64_t one = 1;
+		write(r->notifyfd, &one, sizeof(one));
+	}
+}
 
-	if (cJSON_IsNull(root))
-		return NULL;
-	cJSON_AddNumberToObject(root, "signal", msg.signal);
-	cJSON_AddStringToObject(root, "payload", (const char * const)msg.payload);
-	char *outstr = cJSON_Print(root);
-	cJSON_Delete(root);
-	return outstr;
+/* Queue a text frame for one client (>= 0, WS_MSG_REPLY) or all clients (-1,
+ * WS_MSG_EVENT) and wake the reactor owning it, or every reactor. The frame
+ * is encoded here, once, and the reactors only queue references to it. Must
+ * be called on the AO thread. */
+static void ws_cmd_push(ao_ws_t *me, int target_idx, const char *text) {
+	ws_cmd_push_text(me, target_idx, text, strnlen(text, WS_TX_BUFSZ - 1));
+}
+/* As ws_cmd_push(), for @p len bytes of @p text that need not end in a NUL,
+ * e.g. a broker payload */
+static void ws_cmd_push_text(ao_ws_t *me, int target_idx, const char *text,
+		size_t len) {
+	ws_cmd_push_frame(me, target_idx, 0x1,
+			target_idx < 0 ? WS_MSG_EVENT : WS_MSG_REPLY, 0, text, len);
+}
+/* As ws_cmd_push(), for a data frame of any opcode, message class @p cls and
+ * conflation key @p key (0: none) */
+static void ws_cmd_push_frame(ao_ws_t *me, int target_idx, uint8_t opcode,
+		uint8_t cls, uint32_t key, const void *p, size_t len) {
+	if (target_idx >= WS_MAX_CLIENTS)
+		return;
+	ws_frame_t *f = ws_frame_new(opcode, p, len);
+	if (!f)
+		return;
+	f->cls = cls;
+	f->key = key;
+	if (target_idx >= 0) {
+		ws_cmd_queue(ws_reactor(me, target_idx), target_idx, f);
+		return;
+	}
+	for (int i = 0; i < me->nreactors; i++) {
+		ws_frame_get(f);
+		ws_cmd_queue(&me->reactor[i], -1, f);
+	}
+	ws_frame_put(f);
+}
+
+/* Queue frame @p f, taking over the caller's reference, for the clients set
+ * in f->to: one command per reactor serving any of them */
+static void ws_cmd_push_to(ao_ws_t *me, ws_frame_t *f) {
+	for (int i = 0; i < me->nreactors; i++) {
+		ws_reactor_t *r = &me->reactor[i];
+		for (int k = r->first; k < r->first + r->count; k++)
+			if (ws_frame_to_has(f, k)) {
+				ws_frame_get(f);
+				ws_cmd_queue(r, WS_TO_MASK, f);
+				break;
+			}
+	}
+	ws_frame_put(f);
+}
+
+/* Send the FSM trace ring of every registered AO (or only @p ao_name when not
+ * empty) to client @p idx, one frame per AO of the form
+ * {"type":"trace","ao":"name","entries":[[t_us,"state",signal,"next",dur_us],...]}
+ * where "next" is null when no transition was taken. The registry is copied
+ * once up front; AOs may start or stop on other threads meanwhile. */
+static void ws_send_trace(ao_ws_t *me, int idx, const char *ao_name) {
+	static fsm_trace_entry_t snap[FSM_TRACE_LEN];
+	base_obj_t *aos[MAX_ACTIVE_OBJECTS];
+	int count = active_object_snapshot(aos, MAX_ACTIVE_OBJECTS);
+
+	for (int i = 0; i < count; i++) {
+		const base_obj_t *ao = aos[i];
+		json_writer_t w;
+		if (!ao || (ao_name[0] && strcmp(ao_name, ao->name) != 0))
+			continue;
+		if (!json_writer_init_dynamic(&w, 2 * WS_TX_BUFSZ))
+			return;
+
+		uint16_t n = fsm_trace_snapshot(&ao->fsm, snap, FSM_TRACE_LEN);
+		json_object_begin(&w);
+		json_key(&w, "type");
+		json_string(&w, "trace");
+		json_key(&w, "ao");
+		json_string(&w, ao->name);
+		json_key(&w, "entries");
+		json_array_begin(&w);
+		for (uint16_t k = 0; k < n; k++) {
+			const fsm_trace_entry_t *e = &snap[k];
+			json_array_begin(&w);
+			json_uint(&w, e->timestamp_us);
+			json_string(&w,
+					(e->state && e->state->name) ? e->state->name : "?");
+			json_uint(&w, e->signal);
+			if (e->next_state)
+				json_string(&w,
+						e->next_state->name ? e->next_state->name : "?");
+			else
+				json_null(&w);
+			json_uint(&w, e->duration_us);
+			json_array_end(&w);
+		}
+		json_array_end(&w);
+		json_object_end(&w);
+
+		size_t len;
+		char *text = json_writer_finish(&w, &len);
+		if (text)
+			ws_cmd_push_frame(me, idx, 0x1, WS_MSG_REPLY, 0, text, len);
+		free(text);
+	}
+}
+
+/* Write the statistics members of one timer_stats_t into the open object */
+static void ws_json_timer_stats(json_writer_t *w, const timer_stats_t *st) {
+	json_key(w, "fired");
+	json_uint(w, st->fired);
+	json_key(w, "skipped");
+	json_uint(w, st->skipped);
+	json_key(w, "dropped");
+	json_uint(w, st->dropped);
+	json_key(w, "late_max");
+	json_uint(w, st->max_lateness_us);
+	json_key(w, "run_max");
+	json_uint(w, st->max_runtime_us);
+	json_key(w, "late");
+	json_array_begin(w);
+	for (int b = 0; b < TIMER_HIST_BUCKETS; b++)
+		json_uint(w, st->lateness[b]);
+	json_array_end(w);
+	json_key(w, "run");
+	json_array_begin(w);
+	for (int b = 0; b < TIMER_HIST_BUCKETS; b++)
+		json_uint(w, st->runtime[b]);
+	json_array_end(w);
+}
+
+/* Send the timer statistics to client @p idx as one frame, whatever the
+ * number of timers, so a full pool cannot overrun the command ring:
+ * {"type":"timers","entries":[{"id":n,"period":ms,"slack":ms,
+ *  "owner":"ao"|null,"signal":s,"fired":n,"skipped":n,"dropped":n,
+ *  "late_max":us,"run_max":us,"late":[...],"run":[...]},...]}
+ * where the last entry, id -1, holds the totals and "late"/"run" are log2
+ * histograms in microseconds (see timer_stats_t). */
+static void ws_send_timers(ao_ws_t *me, int idx) {
+	static timer_stats_entry_t snap[TIMER_POOL_SIZE];
+	timers_t *timers = timer_ctor();
+	timer_stats_t total;
+	json_writer_t w;
+
+	if (!timers || !json_writer_init_dynamic(&w, 4 * WS_TX_BUFSZ))
+		return;
+	uint16_t n = timers->stats(snap, TIMER_POOL_SIZE, &total);
+	json_object_begin(&w);
+	json_key(&w, "type");
+	json_string(&w, "timers");
+	json_key(&w, "entries");
+	json_array_begin(&w);
+	for (int i = 0; i < (int) n; i++) {
+		const timer_stats_entry_t *t = &snap[i];
+		json_object_begin(&w);
+		json_key(&w, "id");
+		json_int(&w, i);
+		json_key(&w, "period");
+		json_uint(&w, t->period_ms);
+		json_key(&w, "slack");
+		json_uint(&w, t->slack_ms);
+		json_key(&w, "owner");
+		json_string(&w, t->owner);
+		json_key(&w, "signal");
+		json_uint(&w, t->signal);
+		ws_json_timer_stats(&w, &t->stats);
+		json_object_end(&w);
+	}
+	json_object_begin(&w);
+	json_key(&w, "id");
+	json_int(&w, -1);
+	ws_json_timer_stats(&w, &total);
+	json_object_end(&w);
+	json_array_end(&w);
+	json_object_end(&w);
+
+	size_t len;
+	char *text = json_writer_finish(&w, &len);
+	if (text)
+		ws_cmd_push_frame(me, idx, 0x1, WS_MSG_REPLY, 0, text, len);
+	free(text);
+}
+
+/* Send the send queue metrics to client @p idx as one frame, whatever the
+ * number of clients, so the reply cannot overrun the command ring:
+ * {"type":"clients","clients":[{"slot":n,"id":conn,"depth":frames,"bytes":n,
+ *  "peak":n,"dropped":n,"conflated":n,"stalled_ms":ms},...],
+ *  "evicted":n,"cmd_dropped":n}
+ * where "cmd_dropped" counts frames lost to a full AO->reactor ring. Read
+ * while the reactors run, so a client's figures may be a moment apart. */
+static void ws_send_clients(ao_ws_t *me, int idx) {
+	uint64_t now = ws_now_ms();
+	uint64_t cmd_dropped = 0;
+	json_writer_t w;
+
+	if (!json_writer_init_dynamic(&w, 4 * WS_TX_BUFSZ))
+		return;
+	json_object_begin(&w);
+	json_key(&w, "type");
+	json_string(&w, "clients");
+	json_key(&w, "clients");
+	json_array_begin(&w);
+	for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+		ws_client_t *c = &me->clients[i];
+		if (__atomic_load_n(&c->st, __ATOMIC_RELAXED) != WS_CL_WS)
+			continue;
+		uint64_t stall = __atomic_load_n(&c->out_st.stall_ms, __ATOMIC_RELAXED);
+		json_object_begin(&w);
+		json_key(&w, "slot");
+		json_int(&w, i);
+		json_key(&w, "id");
+		json_uint(&w, __atomic_load_n(&c->conn_id, __ATOMIC_RELAXED));
+		json_key(&w, "depth");
+		json_uint(&w, __atomic_load_n(&c->out_st.depth, __ATOMIC_RELAXED));
+		json_key(&w, "bytes");
+		json_uint(&w, __atomic_load_n(&c->out_st.bytes, __ATOMIC_RELAXED));
+		json_key(&w, "peak");
+		json_uint(&w, __atomic_load_n(&c->out_st.peak, __ATOMIC_RELAXED));
+		json_key(&w, "dropped");
+		json_uint(&w, __atomic_load_n(&c->out_st.dropped, __ATOMIC_RELAXED));
+		json_key(&w, "conflated");
+		json_uint(&w, __atomic_load_n(&c->out_st.conflated, __ATOMIC_RELAXED));
+		json_key(&w, "stalled_ms");
+		json_uint(&w, stall && now > stall ? now - stall : 0);
+		json_object_end(&w);
+	}
+	json_array_end(&w);
+	for (int i = 0; i < me->nreactors; i++)
+		cmd_dropped += __atomic_load_n(&me->reactor[i].cmd.dropped,
+				__ATOMIC_RELAXED);
+	json_key(&w, "evicted");
+	json_uint(&w, __atomic_load_n(&me->evicted, __ATOMIC_RELAXED));
+	json_key(&w, "cmd_dropped");
+	json_uint(&w, cmd_dropped);
+	json_object_end(&w);
+
+	size_t len;
+	char *text = json_writer_finish(&w, &len);
+	if (text)
+		ws_cmd_push_frame(me, idx, 0x1, WS_MSG_REPLY, 0, text, len);
+	free(text);
+}
+
+/* Write {"signal":n,"payload":"..."} for @p msg into @p out; returns the
+ * text length, 0 if it does not fit. No allocation. */
+static size_t ws_json_str(const message_frame_t *msg, char *out, size_t cap) {
+	json_writer_t w;
+	size_t len = 0;
+	json_writer_init(&w, out, cap);
+	json_object_begin(&w);
+	json_key(&w, "signal");
+	json_uint(&w, msg->signal);
+	json_key(&w, "payload");
+	json_string_n(&w, (const char*) msg->payload,
+			strnlen((const char*) msg->payload, MAX_PAYLOAD_SIZE));
+	json_object_end(&w);
+	return json_writer_finish(&w, &len) ? len : 0;
+}
+
+/* Send broker frame @p msg to WS_SUBPROTOCOL client @p idx: no encoding
+ * beyond the 8-byte header. A zero length sends the payload as a string.
+ * Sent as WS_MSG_QUERY, keyed by signal. */
+static void ws_send_binary(ao_ws_t *me, int idx, const message_frame_t *msg) {
+	unsigned char m[WS_BIN_HDR + MAX_PAYLOAD_SIZE];
+	uint32_t len = msg->length ? msg->length :
+			(uint32_t) strnlen((const char*) msg->payload, MAX_PAYLOAD_SIZE);
+	if (len > MAX_PAYLOAD_SIZE)
+		len = MAX_PAYLOAD_SIZE;
+	for (int k = 0; k < 4; k++) {
+		m[k] = (unsigned char) (msg->signal >> (24 - 8 * k));
+		m[4 + k] = (unsigned char) (len >> (24 - 8 * k));
+	}
+	memcpy(m + WS_BIN_HDR, msg->payload, len);
+	ws_cmd_push_frame(me, idx, 0x2, WS_MSG_QUERY, msg->signal, m,
+			WS_BIN_HDR + len);
+}
+
+/* A command from client @p idx, JSON or binary: diagnostics and live
+ * subscriptions are answered here, anything else goes to the broker */
+static void ws_client_command(ao_ws_t *me, int idx, message_frame_t *msg) {
+	/* string argument: a binary payload may fill the frame with no NUL */
+	char arg[MAX_PAYLOAD_SIZE + 1];
+	size_t n = strnlen((const char*) msg->payload, sizeof(msg->payload));
+	memcpy(arg, msg->payload, n);
+	arg[n] = '\0';
+	if (msg->signal == WS_TRACE_QUERY) {
+		ws_send_trace(me, idx, arg);
+		return;
+	}
+	if (msg->signal == WS_TIMER_QUERY) {
+		ws_send_timers(me, idx);
+		return;
+	}
+	if (msg->signal == WS_CLIENTS_QUERY) {
+		ws_send_clients(me, idx);
+		return;
+	}
+	if (msg->signal == WS_LIVE_SUBSCRIBE) {
+		ws_live_subscribe(me, idx, arg);
+		return;
+	}
+	broker_post(me->super.broker, *msg, PRIMARY_QUEUE);
 }
 
 /* AO-side logic (business rules): who / say: / echo */
@@ -791,19 +2707,22 @@ void ws_operational_handler(fsm_t *fsm, const message_frame_t *ev) {
 	case WS_EVT_WS_OPEN : {
 		int idx = 0;
 		memcpy(&idx, ev->payload, sizeof(int));
+		memset(me->live.sub[idx], 0, sizeof(me->live.sub[idx]));
 		char m[WS_TX_BUFSZ];
 		snprintf(m, sizeof(m), "{\"type\":\"hello\",\"id\":%llu}",
 				me->clients[idx].conn_id);
-		ws_send_to(me, idx, m);
+		ws_cmd_push(me, idx, m); /* not ws_send_to(): no post to self */
 	}
 		break;
 
 	case WS_EVT_WS_MSG_RX : {
 		int idx = 0;
 		memcpy(&idx, ev->payload, sizeof(int));
-		const char *text = (const char*) (ev->payload + sizeof(int));
+		const char *text = ev->ptr ? (const char*) ev->ptr :
+				(const char*) (ev->payload + sizeof(int));
 		ws_parse_json(text, &msg);
-		broker_post(me->super.broker, msg, PRIMARY_QUEUE);
+		free(ev->ptr);
+		ws_client_command(me, idx, &msg);
 //		if (!strcmp(text, "who")) {
 //			char m[WS_TX_BUFSZ];
 //			int p = snprintf(m, sizeof(m), "{\"type\":\"who\",\"clients\":[");
@@ -831,49 +2750,52 @@ void ws_operational_handler(fsm_t *fsm, const message_frame_t *ev) {
 //			snprintf(m, sizeof(m), "{\"type\":\"echo\",\"text\":\"%s\"}", text);
 //			ws_send_to(me, idx, m);
 //		}
+	}
+		break;
+	case WS_EVT_WS_BIN_RX : {
+		int idx = 0;
+		memcpy(&idx, ev->payload, sizeof(int));
+		memcpy(&msg.signal, ev->payload + sizeof(int), sizeof(uint32_t));
+		msg.length = ev->length - 2 * sizeof(uint32_t);
+		memcpy(msg.payload, ev->ptr ? ev->ptr :
+				ev->payload + 2 * sizeof(uint32_t), msg.length);
+		free(ev->ptr);
+		ws_client_command(me, idx, &msg);
+	}
+		break;
+	case WS_EVT_CLIENT_CLOSED : {
+		int idx = 0;
+		memcpy(&idx, ev->payload, sizeof(int));
+		memset(me->live.sub[idx], 0, sizeof(me->live.sub[idx]));
 	}
 		break;
 	case WS_QUERY_RX_CMD(0,0) ... WS_QUERY_RX_CMD(0xFF, 0xFF): {
 		int idx = (ev->signal >> 16) & 0x03F;
-		char *text = ws_json_str(*ev);
-//		printf("%s\n",text);
-		ws_send_to(me, idx, text);
-		free(text);
+		if (me->clients[idx].binary) {
+			ws_send_binary(me, idx, ev);
+			break;
+		}
+		char text[WS_TX_BUFSZ];
+		size_t n = ws_json_str(ev, text, sizeof(text));
+		if (n) /* not ws_send_to(): no post to self */
+			ws_cmd_push_frame(me, idx, 0x1, WS_MSG_QUERY, ev->signal, text, n);
 	}
 		break;
-//	case WS_CMD_BROADCAST : {
-//		const char *txt = (const char*) ev->payload;
-//		pthread_mutex_lock(&me->cmd.mx);
-//		int next = (me->cmd.tail + 1)
-//				% (int) (sizeof(me->cmd.q) / sizeof(me->cmd.q[0]));
-//		if (next != me->cmd.head) {
-//			me->cmd.q[me->cmd.tail].target_idx = -1;
-//			strncpy(me->cmd.q[me->cmd.tail].msg, txt, WS_TX_BUFSZ - 1);
-//			me->cmd.q[me->cmd.tail].msg[WS_TX_BUFSZ - 1] = '\0';
-//			me->cmd.tail = next;
-//		}
-//		pthread_mutex_unlock(&me->cmd.mx);
-//		uint64_t one = 1;
-//		write(me->notifyfd, &one, sizeof(one));
-//	}
-//		break;
+	case WS_CMD_BROADCAST :
+		ws_cmd_push_text(me, -1, (const char*) ev->payload,
+				strnlen((const char*) ev->payload, sizeof(ev->payload)));
+		break;
+
+	case WS_LIVE_UPDATE(0, 0) ... WS_LIVE_UPDATE(0xF, 0xF):
+		ws_live_update(me, ev);
+		break;
 
 	case WS_CMD_SEND_TO_ONE : {
 		int idx = 0;
 		memcpy(&idx, ev->payload, sizeof(int));
 		const char *txt = (const char*) (ev->payload + sizeof(int));
-		pthread_mutex_lock(&me->cmd.mx);
-		int next = (me->cmd.tail + 1)
-				% (int) (sizeof(me->cmd.q) / sizeof(me->cmd.q[0]));
-		if (next != me->cmd.head) {
-			me->cmd.q[me->cmd.tail].target_idx = idx;
-			strncpy(me->cmd.q[me->cmd.tail].msg, txt, WS_TX_BUFSZ - 1);
-			me->cmd.q[me->cmd.tail].msg[WS_TX_BUFSZ - 1] = '\0';
-			me->cmd.tail = next;
-		}
-		pthread_mutex_unlock(&me->cmd.mx);
-		uint64_t one = 1;
-		write(me->notifyfd, &one, sizeof(one));
+		ws_cmd_push_text(me, idx, txt,
+				strnlen(txt, sizeof(ev->payload) - sizeof(int)));
 	}
 		break;
 
@@ -898,15 +2820,63 @@ void ws_ctor(ao_ws_t *me, broker_t *broker, char *name, uint16_t port) {
 	me->port = port ? port : 8080;
 	strncpy(me->docroot, "/var/www/html/", sizeof(me->docroot) - 1);
 
-	me->epfd = me->listenfd = me->notifyfd = -1;
+	for (int i = 0; i < WS_REACTORS_MAX; i++) {
+		ws_reactor_t *r = &me->reactor[i];
+		r->ws = me;
+		r->id = i;
+		r->epfd = r->listenfd = r->notifyfd = -1;
+		r->started = 0;
+		r->cmd.head = r->cmd.tail = 0;
+		r->cmd.armed = 0;
+	}
+	ws_set_reactors(me, 1);
+	me->cache.ifd = -1;
 	me->pump_running = 0;
 	me->id_seq = 0;
 	for (int i = 0; i < WS_MAX_CLIENTS; i++)
 		me->clients[i].st = WS_CL_FREE;
+	for (int i = 0; i < WS_MSG_CLASSES; i++)
+		me->out_policy[i] = WS_OUT_DROP;
+	me->out_policy[WS_MSG_LIVE] = WS_OUT_CONFLATE;
+	me->evicted = 0;
+
+	pthread_mutex_init(&me->cache.mx, NULL);
+	pthread_mutex_init(&me->live.mx, NULL);
+
+}
+
+void ws_set_docroot(ao_ws_t *me, const char *path) {
+	if (!me || !path)
+		return;
+	strncpy(me->docroot, path, sizeof(me->docroot) - 1);
+	me->docroot[sizeof(me->docroot) - 1] = '\0';
+	size_t n = strlen(me->docroot);
+	while (n > 1 && me->docroot[n - 1] == '/')
+		me->docroot[--n] = '\0';
+}
 
-	me->cmd.head = me->cmd.tail = 0;
-	pthread_mutex_init(&me->cmd.mx, NULL);
+void ws_set_reactors(ao_ws_t *me, int n) {
+	if (!me || me->pump_running)
+		return;
+	if (n < 1)
+		n = 1;
+	if (n > WS_REACTORS_MAX)
+		n = WS_REACTORS_MAX;
+	if (n > WS_MAX_CLIENTS)
+		n = WS_MAX_CLIENTS;
+	int per = (WS_MAX_CLIENTS + n - 1) / n;
+	n = (WS_MAX_CLIENTS + per - 1) / per; /* no empty partition */
+	me->nreactors = n;
+	for (int i = 0; i < n; i++) {
+		me->reactor[i].first = i * per;
+		me->reactor[i].count = i < n - 1 ? per : WS_MAX_CLIENTS - i * per;
+	}
+}
 
+void ws_set_out_policy(ao_ws_t *me, ws_msg_class_t cls, ws_out_policy_t policy) {
+	if (!me || me->pump_running || (unsigned) cls >= WS_MSG_CLASSES)
+		return;
+	me->out_policy[cls] = (uint8_t) policy;
 }
 
 /* =========================== AO API =========================== */
@@ -27,6 +27,7 @@ int main(void) {
 	udp_obj_t *udp = udp_ctor(broker,"udp_server");
 	ao_ws_t ws;
 	ws_ctor(&ws, broker, "ao_ws", 80);
+	ws_set_reactors(&ws, 2); /* one per A7 core */
 
 
 //	register_active_object((base_obj_t*)&db);
@@ -0,0 +1,662 @@
+/*
+ * ws_bench.c — load generator and benchmark for the ao_ws HTTP/WebSocket pump
+ *
+ * Starts an ao_ws_t on loopback with a synthetic docroot and drives it from
+ * client threads in the same process, one blocking connection per thread.
+ * Scenarios:
+ *   get        keep-alive GET /bench.bin (-z bytes), reconnecting whenever
+ *              the server closes (WS_HTTP_MAX_REQS)
+ *   handshake  connect, WebSocket upgrade up to the 101, reset
+ *   echo       WS_TIMER_QUERY round trip: pump -> AO -> pump, one frame back
+ *   bcast      ws_broadcast() at -R messages/s, fanned out to every client;
+ *              latency is from the broadcast call to the client's read
+ *   all        each of the above in turn
+ * For each scenario it prints operations/s, latency percentiles, CPU time of
+ * the server threads (AO and reactors) and of the whole process (clients
+ * included) over the run, and resident/peak RSS.
+ *
+ * Build (host, from gen_ua27_lx/; not part of the Eclipse build):
+ *   gcc -O2 -std=gnu11 -D_GNU_SOURCE -Isrc/RTEF/include \
+ *       -Isrc/active-objects/includes -Isrc/hal/includes -Isrc \
+ *       tools/ws_bench/ws_bench.c src/active-objects/src/ao_ws.c \
+ *       src/RTEF/src/active_object.c src/RTEF/src/broker.c \
+ *       src/RTEF/src/fsm.c src/RTEF/src/message.c src/RTEF/src/sys_timer.c \
+ *       src/RTEF/src/json_writer.c \
+ *       -o ws_bench -lssl -lcrypto -lcjson -lz -lpthread -lm
+ *
+ * Usage: ws_bench [-s get|handshake|echo|bcast|all] [-c conns] [-d seconds]
+ *                 [-r reactors] [-p port] [-z bytes] [-R rate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "broker.h"
+#include "ao_ws.h"
+
+#define BENCH_BUFSZ   (64 * 1024) /* per connection receive buffer */
+#define BENCH_WS_KEY  "dGhlIHNhbXBsZSBub25jZQ=="
+
+typedef enum {
+	SC_GET = 0, SC_HANDSHAKE, SC_ECHO, SC_BCAST, SC_COUNT
+} scenario_t;
+
+static const char *const sc_names[SC_COUNT] = { "get", "handshake", "echo",
+		"bcast" };
+
+static struct {
+	int conns;
+	int seconds;
+	int reactors;
+	uint16_t port;
+	size_t body; /* /bench.bin size */
+	int rate; /* broadcasts per second */
+	char docroot[64];
+} cfg = { 16, 5, 2, 18080, 4096, 1000, "" };
+
+static volatile int done;
+static int connected; /* bcast clients past the upgrade, atomic */
+
+typedef struct {
+	pthread_t tid;
+	scenario_t sc;
+	uint32_t *lat; /* microseconds, one per operation */
+	size_t n, cap;
+	uint64_t ops, errors;
+} worker_t;
+
+typedef struct {
+	int fd;
+	size_t off, len; /* unread bytes are buf[off, len) */
+	char buf[BENCH_BUFSZ];
+} conn_t;
+
+/* ------------------ small helpers ------------------ */
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void lat_add(worker_t *w, uint64_t ns) {
+	if (w->n == w->cap) {
+		size_t cap = w->cap ? w->cap * 2 : 4096;
+		uint32_t *p = realloc(w->lat, cap * sizeof(*p));
+		if (!p)
+			return;
+		w->lat = p;
+		w->cap = cap;
+	}
+	uint64_t us = ns / 1000;
+	w->lat[w->n++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t) us;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+	return x < y ? -1 : x > y;
+}
+
+static double thread_cpu_s(pthread_t t) {
+	clockid_t id;
+	struct timespec ts;
+	if (pthread_getcpuclockid(t, &id) != 0 || clock_gettime(id, &ts) != 0)
+		return 0;
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/* CPU time of the threads serving: the AO and every reactor */
+static double server_cpu_s(ao_ws_t *ws) {
+	double s = thread_cpu_s(ws->super.thread_id);
+	for (int i = 0; i < ws->nreactors; i++)
+		s += thread_cpu_s(ws->reactor[i].tid);
+	return s;
+}
+
+static double process_cpu_s(void) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (double) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+			+ (double) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static long rss_kb(void) {
+	long pages = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* ------------------ client connection ------------------ */
+static int conn_open(conn_t *c) {
+	c->off = c->len = 0;
+	c->fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (c->fd < 0)
+		return -1;
+	int one = 1;
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	struct timeval tv = { 0, 200000 }; /* reads time out to check done */
+	setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	struct sockaddr_in a = { 0 };
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	a.sin_port = htons(cfg.port);
+	if (connect(c->fd, (struct sockaddr*) &a, sizeof(a)) < 0) {
+		close(c->fd);
+		c->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+static void conn_close(conn_t *c) {
+	if (c->fd >= 0)
+		close(c->fd);
+	c->fd = -1;
+}
+
+/* Close with a reset: churning connections leave no TIME_WAIT behind */
+static void conn_reset(conn_t *c) {
+	if (c->fd >= 0) {
+		struct linger l = { 1, 0 };
+		setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+	}
+	conn_close(c);
+}
+
+static int send_all(int fd, const void *p, size_t n) {
+	const char *b = p;
+	while (n) {
+		ssize_t w = send(fd, b, n, MSG_NOSIGNAL);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		b += w;
+		n -= (size_t) w;
+	}
+	return 0;
+}
+
+/* Read more bytes into @p c. Returns -1 on EOF, error or once done is set. */
+static int conn_more(conn_t *c) {
+	if (c->off && c->len == sizeof(c->buf)) {
+		memmove(c->buf, c->buf + c->off, c->len - c->off);
+		c->len -= c->off;
+		c->off = 0;
+	}
+	if (c->len == sizeof(c->buf))
+		return -1;
+	while (!done) {
+		ssize_t r = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+		if (r > 0) {
+			c->len += (size_t) r;
+			return 0;
+		}
+		if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK
+				&& errno != EINTR))
+			return -1;
+	}
+	return -1;
+}
+
+/* Wait for a header ending in a blank line; returns its length */
+static long conn_head(conn_t *c) {
+	for (;;) {
+		char *e = memmem(c->buf + c->off, c->len - c->off, "\r\n\r\n", 4);
+		if (e)
+			return e + 4 - (c->buf + c->off);
+		if (conn_more(c) < 0)
+			return -1;
+	}
+}
+
+/* ------------------ HTTP ------------------ */
+/* GET @p path and read the whole response; @p closed is set when the server
+ * ends the connection after it */
+static int http_get(conn_t *c, const char *path, int *closed) {
+	char req[128];
+	int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: bench\r\n\r\n",
+			path);
+	if (send_all(c->fd, req, (size_t) n) < 0)
+		return -1;
+	long h = conn_head(c);
+	if (h < 0)
+		return -1;
+	const char *p = c->buf + c->off;
+	if (strncmp(p, "HTTP/1.1 200", 12) != 0)
+		return -1;
+	const char *cl = memmem(p, (size_t) h, "Content-Length: ", 16);
+	size_t body = cl ? strtoul(cl + 16, NULL, 10) : 0;
+	*closed = memmem(p, (size_t) h, "Connection: close", 17) != NULL;
+	c->off += (size_t) h;
+	while (body) {
+		if (c->off == c->len) {
+			c->off = c->len = 0;
+			if (conn_more(c) < 0)
+				return -1;
+		}
+		size_t k = c->len - c->off < body ? c->len - c->off : body;
+		c->off += k;
+		body -= k;
+	}
+	return 0;
+}
+
+/* ------------------ WebSocket ------------------ */
+static int ws_upgrade(conn_t *c) {
+	static const char req[] = "GET / HTTP/1.1\r\nHost: bench\r\n"
+			"Upgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: " BENCH_WS_KEY "\r\n"
+			"Sec-WebSocket-Version: 13\r\n\r\n";
+	if (send_all(c->fd, req, sizeof(req) - 1) < 0)
+		return -1;
+	long h = conn_head(c);
+	if (h < 0 || strncmp(c->buf + c->off, "HTTP/1.1 101", 12) != 0)
+		return -1;
+	c->off += (size_t) h;
+	return 0;
+}
+
+static int ws_send_text(conn_t *c, const char *s) {
+	static const uint8_t mask[4] = { 0x5a, 0xc3, 0x17, 0xe8 };
+	uint8_t f[8 + 4 + 512];
+	size_t len = strlen(s);
+	if (len > 512)
+		return -1;
+	size_t h = 2;
+	f[0] = 0x81;
+	if (len <= 125) {
+		f[1] = (uint8_t) (0x80 | len);
+	} else {
+		f[1] = 0x80 | 126;
+		f[2] = (uint8_t) (len >> 8);
+		f[3] = (uint8_t) len;
+		h = 4;
+	}
+	memcpy(f + h, mask, 4);
+	for (size_t i = 0; i < len; i++)
+		f[h + 4 + i] = (uint8_t) s[i] ^ mask[i & 3];
+	return send_all(c->fd, f, h + 4 + len);
+}
+
+/* Next server frame; @p p points into the connection buffer until the next
+ * read */
+static int ws_read_frame(conn_t *c, uint8_t *op, const char **p, size_t *n) {
+	while (c->len - c->off < 2)
+		if (conn_more(c) < 0)
+			return -1;
+	const uint8_t *b = (const uint8_t*) c->buf + c->off;
+	size_t h = 2, len = b[1] & 0x7F;
+	if (len >= 126) {
+		h = len == 126 ? 4 : 10;
+		while (c->len - c->off < h)
+			if (conn_more(c) < 0)
+				return -1;
+		b = (const uint8_t*) c->buf + c->off;
+		len = 0;
+		for (size_t i = 2; i < h; i++)
+			len = len << 8 | b[i];
+	}
+	if (h + len > sizeof(c->buf))
+		return -1;
+	while (c->len - c->off < h + len)
+		if (conn_more(c) < 0)
+			return -1;
+	*op = c->buf[c->off] & 0x0F;
+	*p = c->buf + c->off + h;
+	*n = len;
+	c->off += h + len;
+	return 0;
+}
+
+/* ------------------ scenarios ------------------ */
+static void run_get(worker_t *w, conn_t *c) {
+	while (!done) {
+		if (c->fd < 0 && conn_open(c) < 0) {
+			w->errors++;
+			usleep(1000);
+			continue;
+		}
+		int closed = 0;
+		uint64_t t0 = now_ns();
+		if (http_get(c, "/bench.bin", &closed) < 0) {
+			if (!done)
+				w->errors++;
+			conn_reset(c);
+			continue;
+		}
+		lat_add(w, now_ns() - t0);
+		w->ops++;
+		if (closed)
+			conn_close(c);
+	}
+}
+
+static void run_handshake(worker_t *w, conn_t *c) {
+	while (!done) {
+		uint64_t t0 = now_ns();
+		if (conn_open(c) < 0 || ws_upgrade(c) < 0) {
+			if (!done)
+				w->errors++;
+			conn_reset(c);
+			continue;
+		}
+		lat_add(w, now_ns() - t0);
+		w->ops++;
+		conn_reset(c);
+	}
+}
+
+static void run_echo(worker_t *w, conn_t *c) {
+	char q[64];
+	snprintf(q, sizeof(q), "{\"signal\":%lu,\"payload\":\"\"}",
+			(unsigned long) WS_TIMER_QUERY);
+	if (conn_open(c) < 0 || ws_upgrade(c) < 0) {
+		w->errors++;
+		return;
+	}
+	while (!done) {
+		uint64_t t0 = now_ns();
+		if (ws_send_text(c, q) < 0)
+			break;
+		/* the totals frame ends the answer; the hello may come first */
+		for (;;) {
+			uint8_t op;
+			const char *p;
+			size_t n;
+			if (ws_read_frame(c, &op, &p, &n) < 0) {
+				if (!done)
+					w->errors++;
+				return;
+			}
+			if (op == 0x1 && memmem(p, n, "\"id\":-1", 7))
+				break;
+		}
+		lat_add(w, now_ns() - t0);
+		w->ops++;
+	}
+}
+
+static void run_bcast(worker_t *w, conn_t *c) {
+	if (conn_open(c) < 0 || ws_upgrade(c) < 0) {
+		w->errors++;
+		return;
+	}
+	__atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+	while (!done) {
+		uint8_t op;
+		const char *p;
+		size_t n;
+		if (ws_read_frame(c, &op, &p, &n) < 0) {
+			if (!done)
+				w->errors++;
+			return;
+		}
+		const char *t = op == 0x1 ? memmem(p, n, "\"t\":", 4) : NULL;
+		if (!t)
+			continue; /* hello */
+		uint64_t sent = strtoull(t + 4, NULL, 10);
+		lat_add(w, now_ns() - sent);
+		w->ops++;
+	}
+}
+
+static void* worker_main(void *arg) {
+	worker_t *w = arg;
+	conn_t *c = malloc(sizeof(*c));
+	if (!c)
+		return NULL;
+	c->fd = -1;
+	switch (w->sc) {
+	case SC_GET:
+		run_get(w, c);
+		break;
+	case SC_HANDSHAKE:
+		run_handshake(w, c);
+		break;
+	case SC_ECHO:
+		run_echo(w, c);
+		break;
+	case SC_BCAST:
+		run_bcast(w, c);
+		break;
+	default:
+		break;
+	}
+	conn_reset(c);
+	free(c);
+	return NULL;
+}
+
+/* Broadcast at cfg.rate for cfg.seconds, stamped with the send time;
+ * returns the count sent */
+static uint64_t bcast_send(ao_ws_t *ws) {
+	uint64_t sent = 0, t_end = now_ns() + (uint64_t) cfg.seconds * 1000000000ull;
+	uint64_t gap = 1000000000ull / (uint64_t) cfg.rate;
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (now_ns() < t_end) {
+		char m[64];
+		snprintf(m, sizeof(m), "{\"type\":\"bench\",\"t\":%llu}",
+				(unsigned long long) now_ns());
+		ws_broadcast(ws, m);
+		sent++;
+		next.tv_nsec += (long) gap;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	return sent;
+}
+
+static void run_scenario(ao_ws_t *ws, scenario_t sc) {
+	worker_t *w = calloc((size_t) cfg.conns, sizeof(*w));
+	if (!w)
+		return;
+	done = 0;
+	connected = 0;
+	double srv0 = server_cpu_s(ws), cpu0 = process_cpu_s();
+	uint64_t t0 = now_ns(), sent = 0;
+	int started = 0;
+	for (; started < cfg.conns; started++) {
+		w[started].sc = sc;
+		if (pthread_create(&w[started].tid, NULL, worker_main, &w[started]))
+			break;
+	}
+
+	if (sc == SC_BCAST) {
+		/* every client upgraded before the first broadcast */
+		for (int i = 0; i < 500
+				&& __atomic_load_n(&connected, __ATOMIC_RELAXED) < started; i++)
+			usleep(10000);
+		t0 = now_ns();
+		sent = bcast_send(ws);
+		usleep(200000); /* let the last ones arrive */
+	} else {
+		sleep((unsigned) cfg.seconds);
+	}
+	done = 1;
+	for (int i = 0; i < started; i++)
+		pthread_join(w[i].tid, NULL);
+	double secs = (double) (now_ns() - t0) / 1e9;
+	double srv = server_cpu_s(ws) - srv0, cpu = process_cpu_s() - cpu0;
+
+	size_t n = 0;
+	uint64_t ops = 0, errors = 0;
+	for (int i = 0; i < started; i++) {
+		n += w[i].n;
+		ops += w[i].ops;
+		errors += w[i].errors;
+	}
+	uint32_t *lat = malloc((n ? n : 1) * sizeof(*lat));
+	size_t k = 0;
+	for (int i = 0; i < started; i++) {
+		if (lat)
+			memcpy(lat + k, w[i].lat, w[i].n * sizeof(*lat));
+		k += w[i].n;
+		free(w[i].lat);
+	}
+	if (lat)
+		qsort(lat, n, sizeof(*lat), cmp_u32);
+#define PCT(q) (lat && n ? lat[(size_t) ((q) * (double) (n - 1))] : 0u)
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%-10s %5d %9llu %10.0f %8u %8u %8u %8u %8.2f %8.2f %8ld %9ld\n",
+			sc_names[sc], started, (unsigned long long) ops, ops / secs,
+			PCT(0.5), PCT(0.99), PCT(0.999), PCT(1.0), srv, cpu, rss_kb(),
+			ru.ru_maxrss);
+#undef PCT
+	if (sc == SC_BCAST)
+		printf("  bcast: %llu sent, %llu of %llu deliveries made\n",
+				(unsigned long long) sent, (unsigned long long) ops,
+				(unsigned long long) sent * (unsigned long long) started);
+	if (errors)
+		printf("  %llu errors\n", (unsigned long long) errors);
+	fflush(stdout);
+	free(lat);
+	free(w);
+	usleep(300000); /* the server frees the slots of reset connections */
+}
+
+/* ------------------ docroot ------------------ */
+static int write_file(const char *name, size_t len, char fill) {
+	char path[sizeof(cfg.docroot) + 32];
+	snprintf(path, sizeof(path), "%s/%s", cfg.docroot, name);
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+	for (size_t i = 0; i < len; i++)
+		fputc(fill, f);
+	return fclose(f);
+}
+
+static void remove_docroot(void) {
+	char path[sizeof(cfg.docroot) + 32];
+	snprintf(path, sizeof(path), "%s/index.html", cfg.docroot);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/bench.bin", cfg.docroot);
+	unlink(path);
+	rmdir(cfg.docroot);
+}
+
+static int wait_listening(void) {
+	conn_t *c = malloc(sizeof(*c));
+	int rc = -1;
+	for (int i = 0; c && i < 300 && rc < 0; i++) {
+		rc = conn_open(c);
+		if (rc < 0)
+			usleep(10000);
+	}
+	if (c)
+		conn_close(c);
+	free(c);
+	return rc;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-s get|handshake|echo|bcast|all] [-c conns] "
+			"[-d seconds] [-r reactors] [-p port] [-z bytes] [-R rate]\n",
+			prog);
+}
+
+int main(int argc, char **argv) {
+	int only = -1; /* all */
+	int opt;
+	while ((opt = getopt(argc, argv, "s:c:d:r:p:z:R:h")) != -1) {
+		switch (opt) {
+		case 's':
+			only = -2;
+			for (int i = 0; i < SC_COUNT; i++)
+				if (!strcmp(optarg, sc_names[i]))
+					only = i;
+			if (!strcmp(optarg, "all"))
+				only = -1;
+			if (only == -2) {
+				usage(argv[0]);
+				return 2;
+			}
+			break;
+		case 'c':
+			cfg.conns = atoi(optarg);
+			break;
+		case 'd':
+			cfg.seconds = atoi(optarg);
+			break;
+		case 'r':
+			cfg.reactors = atoi(optarg);
+			break;
+		case 'p':
+			cfg.port = (uint16_t) atoi(optarg);
+			break;
+		case 'z':
+			cfg.body = strtoul(optarg, NULL, 10);
+			break;
+		case 'R':
+			cfg.rate = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	/* one slot stays free for wait_listening() and stragglers */
+	if (cfg.conns < 1)
+		cfg.conns = 1;
+	if (cfg.conns > WS_MAX_CLIENTS - 1)
+		cfg.conns = WS_MAX_CLIENTS - 1;
+	if (cfg.seconds < 1)
+		cfg.seconds = 1;
+	if (cfg.rate < 1)
+		cfg.rate = 1;
+	signal(SIGPIPE, SIG_IGN);
+
+	strcpy(cfg.docroot, "/tmp/ws_bench.XXXXXX");
+	if (!mkdtemp(cfg.docroot) || write_file("index.html", 64, 'i') < 0
+			|| write_file("bench.bin", cfg.body, 'b') < 0) {
+		perror("docroot");
+		return 1;
+	}
+
+	broker_t *broker = broker_ctor();
+	static ao_ws_t ws;
+	ws_ctor(&ws, broker, "ao_ws", cfg.port);
+	ws_set_docroot(&ws, cfg.docroot);
+	ws_set_reactors(&ws, cfg.reactors);
+	ws.super.vptr->start((base_obj_t*) &ws);
+	if (wait_listening() < 0) {
+		fprintf(stderr, "server not listening on port %u\n", cfg.port);
+		remove_docroot();
+		return 1;
+	}
+
+	printf("ws_bench: %d reactors, %d conns, %d s, body %zu B, bcast %d/s\n",
+			ws.nreactors, cfg.conns, cfg.seconds, cfg.body, cfg.rate);
+	printf("%-10s %5s %9s %10s %8s %8s %8s %8s %8s %8s %8s %9s\n", "scenario",
+			"conns", "ops", "ops/s", "p50_us", "p99_us", "p999_us", "max_us",
+			"srv_cpu", "cpu_s", "rss_kb", "maxrss_kb");
+	for (int sc = 0; sc < SC_COUNT; sc++)
+		if (only < 0 || only == sc)
+			run_scenario(&ws, (scenario_t) sc);
+
+	remove_docroot();
+	return 0;
+}
@@ -11,7 +11,6 @@ gain_mode_select.set("Manual", "OMS,001M");
 gain_mode_select.set("AGC", "OMS,001A");
 gain_mode_select.set("Fixed", "OMS,001F");
 
-fetch_control_id = "";
 var temp_value;
 
 class Module {
@@ -66,12 +65,14 @@ class Module {
         }
 
     startInterval() {
-        fetch_control_id = setInterval(this.fetch_control, 2000);
+        var slot_index = parseInt(this.slot_id) - 1;
+        this.control_topic = this.Document.set_live_callbacks("module_control", slot_index, this.fetch_control, 2000);
+        this.Document.set_live_callbacks("module_monitoring", slot_index, this.fetch_module_monitoring, 1000);
+        live.subscribe("module_info", slot_index, this.fetch_info, null, 0, window);
     }
 
     restartInterval() {
-        clearInterval(fetch_control_id); // Clear the existing interval
-        this.startInterval(); // Start a new interval
+        live.restart(this.control_topic); // only polls while the live socket is down
     }
 
     add_control_event_listener() {
@@ -251,12 +252,8 @@ class Module {
 		this.postrcm(url);
 	}
 
-    fetch_control() {
-        fetch("../module_control.json", {
-                method: 'GET',
-                cache: 'no-cache', // Specify 'no-cache' to prevent caching
-            })
-            .then((response) => response.json())
+    fetch_control(pushed) {
+        Live.json("../module_control.json", pushed)
             .then((item) => {
 				var slot_index = parseInt(this.slot_id) - 1;
                 this.Document.getElementById("GainSet").value = parseFloat(item[slot_index].gain).toFixed(2) + "dB";
@@ -294,12 +291,8 @@ class Module {
             .catch((error) => console.log("Error fetching data:", error));
     }
 
-    fetch_module_monitoring() {
-        fetch("../module_monitoring.json", {
-                method: 'GET',
-                cache: 'no-cache',
-            })
-            .then((response) => response.json())
+    fetch_module_monitoring(pushed) {
+        Live.json("../module_monitoring.json", pushed)
             .then((item) => {
 				var slot_index = parseInt(this.slot_id) - 1;
 				var cell;
@@ -362,12 +355,8 @@ class Module {
             .catch((error) => console.log("Error fetching data:", error));
     }
 
-    fetch_info() {
-        fetch("../module_info.json", {
-                method: 'GET',
-                cache: 'no-cache', // Specify 'no-cache' to prevent caching
-            })
-            .then((response) => response.json())
+    fetch_info(pushed) {
+        Live.json("../module_info.json", pushed)
             .then((item) => {
 				var slot_index = parseInt(this.slot_id) - 1;
                 document.getElementById("address").innerHTML = "Slot " + parseInt(this.slot_id);
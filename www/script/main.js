@@ -95,6 +95,16 @@ class Doc {
         return setInterval(callback, timer_interval);
     }
 
+    /**
+     * Like set_intervals_callbacks(), but the callback runs when the server
+     * pushes a change to live document @doc (optionally only @slot) and gets
+     * the document as argument; it is polled every timer_interval only while
+     * the live socket is down.
+     */
+    set_live_callbacks(doc, slot, callback, timer_interval) {
+        return live.subscribe(doc, slot, callback, callback, timer_interval, window);
+    }
+
     clear_intervals_callbacks(callback_id) {
         return clearInterval(callback_id);
     }
@@ -111,6 +121,253 @@ class Doc {
     }
 }
 
+/* WS_LIVE_SUBSCRIBE in RTEF message.h */
+const WS_LIVE_SUBSCRIBE = 0x48C00020;
+/* WS_SUBPROTOCOL in ao_ws.h: broker frames as binary messages */
+const WS_SUBPROTOCOL = 'rtef.frame';
+const WS_BIN_HDR = 8;
+/* Live documents that are a single record rather than an array by slot */
+const live_single_docs = ['settings', 'log'];
+
+/**
+ * One WebSocket per browser window multiplexing every live document shown in
+ * it: the top-level page owns the socket and the pages in its frames use it
+ * too (see shared_live()), tagging their topics with their own window so they
+ * are dropped when the frame navigates away. The server
+ * pushes {"type":"live","doc":name,"slot":n,"data":record} as records change;
+ * callbacks get the document in the shape of its .json endpoint, kept up to
+ * date here from the pushed records. A topic polls until the first record
+ * for it is pushed, so documents nothing publishes keep coming from their
+ * .json endpoint, and polls again while the socket is down.
+ * The socket offers WS_SUBPROTOCOL, so broker frames arrive as binary
+ * messages (see decode_frame()) and go to the on_frame() callbacks.
+ */
+class Live {
+    constructor() {
+        this.topics = [];
+        this.frame_callbacks = [];
+        this.docs = {};
+        this.socket = null;
+        this.open = false;
+        this.retry = null;
+        this.connect = this.connect.bind(this);
+    }
+
+    connect() {
+        this.retry = null;
+        if (!('WebSocket' in window)) {
+            return;
+        }
+        var scheme = (location.protocol === 'https:') ? 'wss://' : 'ws://';
+        try {
+            this.socket = new WebSocket(scheme + location.host + '/', [WS_SUBPROTOCOL]);
+        } catch (error) {
+            this.socket = null;
+            return;
+        }
+        this.socket.binaryType = 'arraybuffer';
+        this.socket.onopen = () => {
+            this.open = true;
+            this.send_topics();
+        };
+        this.socket.onmessage = (event) => {
+            if (typeof event.data === 'string') {
+                this.dispatch(event.data);
+            } else {
+                this.dispatch_frame(Live.decode_frame(event.data));
+            }
+        };
+        this.socket.onclose = () => {
+            this.open = false;
+            this.socket = null;
+            this.topics.forEach((topic) => this.start_poll(topic));
+            this.retry = setTimeout(this.connect, 5000);
+        };
+    }
+
+    /**
+     *
+     * @param {live document name, e.g. 'module_control'} doc
+     * @param {slot index, or null for every slot} slot
+     * @param {called with the document on every push} callback
+     * @param {called with no argument while polling, or null} poll
+     * @param {poll period in ms} period
+     * @returns topic handle for restart()
+     */
+    subscribe(doc, slot, callback, poll, period, owner) {
+        var topic = { doc: doc, slot: slot, callback: callback, poll: poll, period: period, timer: null, owner: owner || window };
+        this.topics.push(topic);
+        this.start_poll(topic);
+        if (this.open) {
+            this.send_topics();
+        } else if (this.socket === null && this.retry === null) {
+            this.connect();
+        }
+        return topic;
+    }
+
+    /* call @callback with every broker frame the server sends this window */
+    on_frame(callback, owner) {
+        this.frame_callbacks.push({ callback: callback, owner: owner || window });
+    }
+
+    /* forget the topics and frame callbacks of @owner, a frame being unloaded */
+    release(owner) {
+        this.topics = this.topics.filter((topic) => {
+            if (topic.owner !== owner) {
+                return true;
+            }
+            this.stop_poll(topic);
+            return false;
+        });
+        this.frame_callbacks = this.frame_callbacks.filter((entry) => entry.owner !== owner);
+        if (this.open) {
+            this.send_topics();
+        }
+    }
+
+    /* send a broker frame, binary when the server agreed to WS_SUBPROTOCOL */
+    send_frame(signal, payload) {
+        if (this.socket.protocol === WS_SUBPROTOCOL) {
+            this.socket.send(Live.encode_frame(signal, payload));
+        } else {
+            this.socket.send(JSON.stringify({ signal: signal, payload: payload }));
+        }
+    }
+
+    /* restart the poll period of @topic, e.g. after posting a command */
+    restart(topic) {
+        if (topic && topic.timer !== null) {
+            this.stop_poll(topic);
+            this.start_poll(topic);
+        }
+    }
+
+    start_poll(topic) {
+        if (topic.poll && topic.timer === null) {
+            topic.timer = setInterval(topic.poll, topic.period);
+        }
+    }
+
+    stop_poll(topic) {
+        if (topic.timer !== null) {
+            clearInterval(topic.timer);
+            topic.timer = null;
+        }
+    }
+
+    /* the server replaces the whole set on each message: send all topics */
+    send_topics() {
+        var list = [];
+        this.topics.forEach((topic) => {
+            var name = (topic.slot === null) ? topic.doc : topic.doc + ':' + topic.slot;
+            if (!list.includes(name)) {
+                list.push(name);
+            }
+        });
+        this.send_frame(WS_LIVE_SUBSCRIBE, list.join(','));
+    }
+
+    dispatch_frame(frame) {
+        if (frame !== null) {
+            this.frame_callbacks.forEach((entry) => entry.callback(frame));
+        }
+    }
+
+    /**
+     * Binary broker frame: signal and length as big-endian uint32, then the
+     * payload. Returns {signal, length, payload (Uint8Array), text (payload up
+     * to the first NUL)}, or null when truncated.
+     */
+    static decode_frame(buffer) {
+        if (buffer.byteLength < WS_BIN_HDR) {
+            return null;
+        }
+        var view = new DataView(buffer);
+        var length = view.getUint32(4);
+        if (buffer.byteLength < WS_BIN_HDR + length) {
+            return null;
+        }
+        var payload = new Uint8Array(buffer, WS_BIN_HDR, length);
+        var end = payload.indexOf(0);
+        return {
+            signal: view.getUint32(0),
+            length: length,
+            payload: payload,
+            text: new TextDecoder().decode(end < 0 ? payload : payload.subarray(0, end)),
+        };
+    }
+
+    static encode_frame(signal, payload) {
+        var bytes = (typeof payload === 'string') ? new TextEncoder().encode(payload) : payload;
+        var buffer = new ArrayBuffer(WS_BIN_HDR + bytes.length);
+        var view = new DataView(buffer);
+        view.setUint32(0, signal);
+        view.setUint32(4, bytes.length);
+        new Uint8Array(buffer, WS_BIN_HDR).set(bytes);
+        return buffer;
+    }
+
+    dispatch(text) {
+        var msg;
+        try {
+            msg = JSON.parse(text);
+        } catch (error) {
+            return;
+        }
+        if (msg.type !== 'live') {
+            return;
+        }
+        if (live_single_docs.includes(msg.doc)) {
+            this.docs[msg.doc] = msg.data;
+        } else {
+            if (!Array.isArray(this.docs[msg.doc])) {
+                this.docs[msg.doc] = [];
+            }
+            this.docs[msg.doc][msg.slot] = msg.data;
+        }
+        this.topics.forEach((topic) => {
+            if (topic.doc === msg.doc && (topic.slot === null || topic.slot === msg.slot)) {
+                this.stop_poll(topic); /* pushed from now on */
+                topic.callback(this.docs[msg.doc]);
+            }
+        });
+    }
+
+    /**
+     * Resolve to the pushed document when a live callback supplied one,
+     * otherwise fetch it from @url.
+     */
+    static json(url, pushed) {
+        if (pushed !== undefined) {
+            return Promise.resolve(pushed);
+        }
+        return fetch(url, {
+                method: 'GET',
+                cache: 'no-cache', // Specify 'no-cache' to prevent caching
+            })
+            .then((response) => response.json());
+    }
+}
+
+/**
+ * The Live instance of this browser window: the top-level page's when this
+ * page is in one of its frames, so the window keeps a single socket.
+ */
+function shared_live() {
+    try {
+        if (window.top !== window && window.top.rtef_live) {
+            var top_live = window.top.rtef_live;
+            window.addEventListener('pagehide', () => top_live.release(window));
+            return top_live;
+        }
+    } catch (error) {} /* top-level page from another origin */
+    window.rtef_live = new Live();
+    return window.rtef_live;
+}
+
+const live = shared_live();
+
 const slotId = ['S1', 'S2', 'S3', 'S4', 'CPU'];
 const settings_id = ['sum', 'config', 'log', 'load'];
 const settings_names = ['SUM', 'CONFIG', 'LOG', 'UPGRADE'];
@@ -322,12 +579,8 @@ class Body {
         });
     }
 
-    update_sidebar() {
-        fetch("sidebar.json", {
-                method: 'GET',
-                cache: 'no-cache', // Specify 'no-cache' to prevent caching
-            })
-            .then((response) => response.json())
+    update_sidebar(pushed) {
+        Live.json("sidebar.json", pushed)
             .then((jsonArray) => {
 				var sum_alarm = 0;
                 jsonArray.forEach((item) => {
@@ -355,12 +608,8 @@ class Body {
             })
             .catch((error) => console.log("Error fetching data:", error));
     }
-    update_summary() {
-        fetch("../summary.json", {
-                method: 'GET',
-                cache: 'no-cache', // Specify 'no-cache' to prevent caching
-            })
-            .then((response) => response.json())
+    update_summary(pushed) {
+        Live.json("../summary.json", pushed)
             .then((jsonArray) => {
                 jsonArray.forEach((item) => {
                     if (item.present === 1)